@@ -0,0 +1,597 @@
+/**
+ * Micro benchmarks for the counting pipeline, built separately from the counter:
+ *   g++ -O3 -pthread bench.cpp -o bench -lz
+ *
+ *   ./bench encode genome.fna [k] [repeats]
+ * Scans a genome with every encoder the cpu supports and with the switch/modulo loop readFile used before the SIMD
+ * kernels, and prints GB/s for each. The kmers only get xor'ed together, so this measures the encoding alone.
+ *
+ *   ./bench generate folder [--genomes N] [--length N] [--gc F] [--shared F] [--contigs N] [--resistant F] [--seed N]
+ * Writes a synthetic collection(syntheticGenomes.h) and its meta.csv, the same options always give the same files.
+ *
+ *   ./bench suite folder [--k 15,31,45] [--threads 1,2,4] [--repeats N] [--canonical] [--json bench.json]
+ * Times every stage on the genomes of folder for every k and thread count: encoding, inserting into one table that
+ * grows from empty, sharded counting and counting through minimizer buckets(--super-kmers), sorting the shards,
+ * merging them, and writing csv and counts.kmc. Every stage
+ * is run repeats times, the JSON has the fastest and the median run, one result a line.
+ *
+ *   ./bench compare before.json after.json
+ * Lines the results of two suites up and prints how much faster or slower every stage got.
+ */
+
+#include <chrono>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include "fastaScanner.h"
+#include "mappedFile.h"
+#include "kmerTable.h"
+#include "shards.h"
+#include "fileQueue.h"
+#include "sortedRuns.h"
+#include "countsFile.h"
+#include "syntheticGenomes.h"
+#include "superKmers.h"
+
+#define MB 1048576.0
+
+// Stands in for the kmer tables, keeps the compiler from throwing the kmers away
+template<typename K>
+struct ChecksumSink{
+    typedef K Kmer;
+    size_t checksum{};
+    size_t kmers{};
+    void push(Kmer data, uint32_t, bool){
+        checksum ^= static_cast<size_t>(data) + kmers;
+        kmers++;
+    }
+};
+
+// A single table without the shards or the per file set in front of it, every kmer goes straight into push
+template<typename K>
+struct TableSink{
+    typedef K Kmer;
+    KmerTable<Kmer> table{0};
+    void push(Kmer data, uint32_t fileNr, bool isRes){
+        table.push(data, fileNr, isRes);
+    }
+};
+
+// The inner loop of readFile before the SIMD kernels: a switch per byte and a 64 bit modulo per nucleotide
+void legacyScan(const size_t k, const size_t size, ScanState<size_t> &state, const char *nucleotides, ChecksumSink<size_t> *table){
+    const size_t kmerMax = (size_t) 1 << (2 * k);
+    size_t val = state.val;
+    size_t length = state.length;
+    bool lineStart = state.lineStart;
+    bool inHeader = state.inHeader;
+    for (size_t i = 0; i < size; i++){
+        if (inHeader){
+            auto *lineEnd = static_cast<const char*>(std::memchr(nucleotides + i, '\n', size - i));
+            if (!lineEnd) break;
+            i = lineEnd - nucleotides;
+            inHeader = false;
+            lineStart = true;
+            continue;
+        }
+        size_t code;
+        switch (nucleotides[i]) {
+            case 'a': case 'A': code = 0; break;
+            case 'c': case 'C': code = 1; break;
+            case 'g': case 'G': code = 2; break;
+            case 't': case 'T': code = 3; break;
+            case '\n':
+                lineStart = true;
+                continue;
+            case '\r':
+                continue;
+            case '>':
+                inHeader = lineStart;
+                lineStart = false;
+                length = 0;
+                continue;
+            default:
+                lineStart = false;
+                length = 0;
+                continue;
+        }
+        val <<= 2;
+        val %= kmerMax;
+        val += code;
+        lineStart = false;
+        if (length < k && ++length < k) continue;
+        table->push(val, 0, true);
+    }
+    state.val = val;
+    state.length = length;
+    state.lineStart = lineStart;
+    state.inHeader = inHeader;
+}
+
+template<typename Scan>
+void timeScan(const char *name, const MappedFile &genome, int repeats, Scan scan){
+    ChecksumSink<size_t> sink;
+    auto start = std::chrono::high_resolution_clock::now();
+    for (int r = 0; r < repeats; r++) {
+        ScanState<size_t> state;
+        scan(state, sink);
+    }
+    auto stop = std::chrono::high_resolution_clock::now();
+    double seconds = std::chrono::duration_cast<std::chrono::nanoseconds>(stop - start).count() / 1e9;
+    double gigabytes = (double) genome.size * repeats / 1e9;
+    std::cout << name << "\t" << gigabytes / seconds << " GB/s\t" << sink.kmers / repeats << " kmers\tchecksum " << sink.checksum << "\n";
+}
+
+int benchEncode(const std::string &path, size_t k, int repeats){
+    MappedFile genome(path);
+    if (!genome.opened || genome.size == 0){
+        std::cout << "couldn't open " << path << "\n";
+        return 1;
+    }
+    std::cout << "encoding " << genome.size / 1048576.0 << " MB, k = " << k << ", " << repeats << " repeats\n";
+    timeScan("legacy", genome, repeats, [&](ScanState<size_t> &state, ChecksumSink<size_t> &sink){
+        legacyScan(k, genome.size, state, genome.data, &sink);
+    });
+    EncodeFunction picked = encodeBlock;
+    for (EncodeFunction encoder : availableEncoders()) {
+        encodeBlock = encoder;
+        timeScan(encoderName(encoder), genome, repeats, [&](ScanState<size_t> &state, ChecksumSink<size_t> &sink){
+            readFile(k, false, genome.size, 1, true, state, genome.data, &sink);
+        });
+    }
+    encodeBlock = picked;
+    return 0;
+}
+
+// One stage at one k and thread count, ms of every repeat
+struct BenchResult{
+    std::string bench;
+    std::string variant; // encoder, table kind and such, empty if there's only one
+    size_t k;
+    size_t threads;
+    size_t bytes; // input the stage went through, fasta for the counting stages and output for the writers
+    size_t kmers;
+    std::vector<double> ms;
+
+    BenchResult(std::string bench, std::string variant, size_t k, size_t threads, size_t bytes, size_t kmers = 0)
+        : bench(std::move(bench)), variant(std::move(variant)), k(k), threads(threads), bytes(bytes), kmers(kmers){}
+};
+
+class BenchResults{
+public:
+    std::vector<BenchResult> results;
+
+    void add(BenchResult result){
+        std::sort(result.ms.begin(), result.ms.end());
+        double best = result.ms.front();
+        std::cout << result.bench << (result.variant.empty() ? "" : "(" + result.variant + ")") << "\tk = " << result.k
+                  << "\t" << result.threads << " threads\t" << best << " ms\t" << result.bytes / MB / (best / 1000) << " MB/s\t"
+                  << result.kmers / (best / 1000) / 1e6 << " M kmers/s\n";
+        results.push_back(std::move(result));
+    }
+
+    // One result a line so compare(and grep) can take them apart without a JSON parser
+    bool write(const std::string &path, size_t genomes, size_t bytes) const{
+        std::ofstream out(path);
+        out.precision(10);
+        out << "{\n  \"genomes\": " << genomes << ",\n  \"bytes\": " << bytes << ",\n  \"encoder\": \"" << encoderName(encodeBlock)
+            << "\",\n  \"hardware_threads\": " << std::thread::hardware_concurrency() << ",\n  \"results\": [";
+        for (size_t i = 0; i < results.size(); i++) {
+            const BenchResult &result = results[i];
+            double best = result.ms.front(), median = result.ms[result.ms.size() / 2];
+            out << (i ? ",\n" : "\n") << "    {\"bench\": \"" << result.bench << "\", \"variant\": \"" << result.variant
+                << "\", \"k\": " << result.k << ", \"threads\": " << result.threads << ", \"repeats\": " << result.ms.size()
+                << ", \"ms\": " << best << ", \"median_ms\": " << median << ", \"bytes\": " << result.bytes
+                << ", \"kmers\": " << result.kmers << ", \"mb_per_s\": " << result.bytes / MB / (best / 1000)
+                << ", \"mkmers_per_s\": " << result.kmers / (best / 1000) / 1e6 << "}";
+        }
+        out << "\n  ]\n}\n";
+        return !out.fail();
+    }
+};
+
+template<typename Work>
+double timeMs(Work work){
+    auto start = std::chrono::steady_clock::now();
+    work();
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+// The genomes of a folder, all mapped up front so the stages don't time the disk
+struct Collection{
+    std::vector<GenomeFile> files;
+    std::vector<MappedFile*> mapped; // by fileNr - 1
+    GenomeList genomes;
+    size_t bytes{};
+
+    ~Collection(){
+        for (MappedFile *file : mapped) {
+            delete file;
+        }
+    }
+};
+
+// Only the two columns the counter uses: the genome id in the second and the phenotype in the fifth
+std::map<std::string, bool> readPhenotypes(const std::string &path){
+    std::map<std::string, bool> phenotypes;
+    std::ifstream meta(path);
+    std::string line;
+    std::getline(meta, line);
+    while (std::getline(meta, line)){
+        std::vector<std::string> columns;
+        std::stringstream ss(line);
+        std::string column;
+        while (std::getline(ss, column, ',')) {
+            column.erase(std::remove(column.begin(), column.end(), '"'), column.end());
+            columns.push_back(column);
+        }
+        if (columns.size() < 5) continue;
+        if (columns[4] == "Resistant") phenotypes[columns[1]] = true;
+        else if (columns[4] == "Susceptible") phenotypes[columns[1]] = false;
+    }
+    return phenotypes;
+}
+
+bool loadCollection(const std::string &folder, Collection &collection){
+    std::map<std::string, bool> phenotypes = readPhenotypes(folder + "/meta.csv");
+    std::vector<std::filesystem::directory_entry> entries;
+    for (const auto &entry : std::filesystem::directory_iterator(folder)) {
+        if (entry.path().extension() == ".fna" && phenotypes.count(entry.path().stem().string())) entries.push_back(entry);
+    }
+    std::sort(entries.begin(), entries.end());
+    for (const auto &entry : entries) {
+        auto *file = new MappedFile(entry.path().string());
+        if (!file->opened){
+            std::cout << "couldn't open " << entry.path().string() << "\n";
+            delete file;
+            return false;
+        }
+        bool resistant = phenotypes[entry.path().stem().string()];
+        collection.mapped.push_back(file);
+        collection.genomes.add(entry.path().stem().string(), resistant);
+        collection.files.push_back({entry, resistant, static_cast<uint32_t>(collection.mapped.size()), file->size, false});
+        collection.bytes += file->size;
+    }
+    return !collection.files.empty();
+}
+
+// Reads every genome into sink on one thread
+template<typename Sink>
+void scanCollection(const Collection &collection, size_t k, bool canonical, Sink &sink){
+    for (const GenomeFile &file : collection.files) {
+        const MappedFile *genome = collection.mapped[file.fileNr - 1];
+        ScanState<typename Sink::Kmer> state;
+        readFile(k, canonical, genome->size, file.fileNr, file.resistant, state, genome->data, &sink);
+    }
+}
+
+// Counts the collection the way countShard does, without the filters
+template<typename Kmer>
+ShardedCounter<Kmer> *countCollection(const Collection &collection, size_t k, bool canonical, size_t threadCount){
+    FileQueue queue(collection.files, threadCount);
+    auto *counter = new ShardedCounter<Kmer>(threadCount, queue.largestTask);
+    onThreads(threadCount, [&](size_t shard){
+        ShardRouter<Kmer> router(*counter, shard, queue.largestTask);
+        while (const FileTask *task = queue.next()){
+            const GenomeFile &file = *task->file;
+            const MappedFile *genome = collection.mapped[file.fileNr - 1];
+            ScanState<Kmer> state;
+            if (task->pieces > 1){
+                PieceFilter<ShardRouter<Kmer>> piece(&router, task->piece, task->pieces);
+                readFile(k, canonical, genome->size, file.fileNr, file.resistant, state, genome->data, &piece);
+            }
+            else readFile(k, canonical, genome->size, file.fileNr, file.resistant, state, genome->data, &router);
+        }
+        router.flush();
+        counter->finish(shard);
+    });
+    return counter;
+}
+
+// The same kmers on any thread count and either way of counting give the same sum
+template<typename Kmer>
+size_t countsChecksum(const Slot<Kmer> *slots, size_t count){
+    size_t checksum = 0;
+    for (size_t i = 0; i < count; i++) {
+        checksum += mixHash(slots[i].data) ^ ((size_t) slots[i].resOccurences << 32 | slots[i].susOccurences);
+    }
+    return checksum;
+}
+
+// Counts the collection the way countSuperKmers does and returns how many distinct kmers there are
+template<typename Kmer>
+size_t countSuperKmerCollection(const Collection &collection, size_t k, bool canonical, size_t threadCount, size_t &checksum){
+    FileQueue queue(collection.files, threadCount);
+    SuperKmerBuckets<Kmer> buckets(k, canonical, threadCount, SuperKmerBuckets<Kmer>::bucketCountFor(queue.largestTask, collection.files.size(), threadCount));
+    onThreads(threadCount, [&](size_t reader){
+        SuperKmerRouter<Kmer> router(buckets, reader);
+        while (const FileTask *task = queue.next()){
+            const GenomeFile &file = *task->file;
+            const MappedFile *genome = collection.mapped[file.fileNr - 1];
+            ScanState<Kmer> state;
+            if (task->pieces > 1){
+                PieceFilter<SuperKmerRouter<Kmer>> piece(&router, task->piece, task->pieces);
+                readFile(k, canonical, genome->size, file.fileNr, file.resistant, state, genome->data, &piece);
+            }
+            else readFile(k, canonical, genome->size, file.fileNr, file.resistant, state, genome->data, &router);
+        }
+    });
+    std::atomic<size_t> distinct{0}, sum{0};
+    countBuckets(buckets, threadCount, [&](size_t, KmerTable<Kmer> &table){
+        size_t count = table.compact();
+        distinct += count;
+        sum += countsChecksum(table.slots, count);
+    });
+    checksum = sum;
+    return distinct;
+}
+
+template<typename Kmer>
+void benchStages(const Collection &collection, size_t k, bool canonical, const std::vector<size_t> &threadCounts, int repeats, BenchResults &results){
+    // one thread only, every encoder the cpu has and the old loop where it still works(k < 32)
+    EncodeFunction picked = encodeBlock;
+    size_t kmers = 0;
+    if (k < 32 && !canonical){
+        BenchResult legacy{"encode", "legacy", k, 1, collection.bytes};
+        for (int r = 0; r < repeats; r++) {
+            ChecksumSink<size_t> sink;
+            legacy.ms.push_back(timeMs([&]{
+                for (const MappedFile *genome : collection.mapped) {
+                    ScanState<size_t> state;
+                    legacyScan(k, genome->size, state, genome->data, &sink);
+                }
+            }));
+            legacy.kmers = sink.kmers;
+        }
+        results.add(legacy);
+    }
+    for (EncodeFunction encoder : availableEncoders()) {
+        encodeBlock = encoder;
+        BenchResult encode{"encode", encoderName(encoder), k, 1, collection.bytes};
+        for (int r = 0; r < repeats; r++) {
+            ChecksumSink<Kmer> sink;
+            encode.ms.push_back(timeMs([&]{ scanCollection(collection, k, canonical, sink); }));
+            kmers = encode.kmers = sink.kmers;
+        }
+        results.add(encode);
+    }
+    encodeBlock = picked;
+
+    // every kmer of every genome into one table that starts out small, this is push and grow on their own
+    BenchResult insert{"insert", "table", k, 1, collection.bytes, kmers};
+    size_t grows = 0;
+    for (int r = 0; r < repeats; r++) {
+        auto *sink = new TableSink<Kmer>();
+        insert.ms.push_back(timeMs([&]{ scanCollection(collection, k, canonical, *sink); }));
+        grows = sink->table.grows;
+        delete sink;
+    }
+    results.add(insert);
+    std::cout << "\t" << grows << " resizes\n";
+
+    for (size_t threadCount : threadCounts) {
+        BenchResult count{"count", "sharded", k, threadCount, collection.bytes, kmers};
+        BenchResult superKmers{"count", "super-k-mers", k, threadCount, collection.bytes, kmers};
+        BenchResult sort{"sort", "", k, threadCount, 0};
+        BenchResult merge{"merge", "", k, threadCount, 0};
+        BenchResult csv{"write", "csv", k, threadCount, 0};
+        BenchResult binary{"write", "binary", k, threadCount, 0};
+        std::string csvPath = (std::filesystem::temp_directory_path() / "bench_counts.csv").string();
+        std::string binaryPath = (std::filesystem::temp_directory_path() / "bench_counts.kmc").string();
+        size_t mergeChecksum = 0; // printed so the merge can't be optimized away
+        size_t shardedChecksum = 0, superChecksum = 0, shardedDistinct = 0, superDistinct = 0;
+        for (int r = 0; r < repeats; r++) {
+            ShardedCounter<Kmer> *counter = nullptr;
+            count.ms.push_back(timeMs([&]{ counter = countCollection<Kmer>(collection, k, canonical, threadCount); }));
+            SortedRuns<Kmer> runs;
+            size_t distinct = 0;
+            for (size_t shard = 0; shard < threadCount; shard++) {
+                KmerTable<Kmer> *table = counter->tables[shard];
+                table->count = table->compact();
+                runs.slots.push_back(table->slots);
+                runs.sizes.push_back(table->count);
+                distinct += table->count;
+            }
+            sort.kmers = merge.kmers = csv.kmers = binary.kmers = shardedDistinct = distinct;
+            shardedChecksum = 0;
+            for (size_t shard = 0; shard < threadCount; shard++) {
+                shardedChecksum += countsChecksum(runs.slots[shard], runs.sizes[shard]);
+            }
+            superKmers.ms.push_back(timeMs([&]{ superDistinct = countSuperKmerCollection<Kmer>(collection, k, canonical, threadCount, superChecksum); }));
+            sort.ms.push_back(timeMs([&]{
+                onThreads(threadCount, [&](size_t shard){
+                    std::sort(counter->tables[shard]->slots, counter->tables[shard]->slots + runs.sizes[shard], writeOrder<Kmer>);
+                });
+            }));
+            // what one writer thread does with its parts, the whole output merged on one thread
+            size_t checksum = 0;
+            std::vector<size_t> begins(threadCount, 0);
+            merge.ms.push_back(timeMs([&]{
+                mergeRuns(runs, begins.data(), runs.sizes.data(), writeOrder<Kmer>, [&](const Slot<Kmer> &slot){
+                    checksum += static_cast<size_t>(slot.data) ^ slot.resOccurences;
+                });
+            }));
+            mergeChecksum = checksum;
+            csv.ms.push_back(timeMs([&]{
+                std::ofstream out(csvPath);
+                size_t partCount;
+                std::vector<size_t> bounds = splitRuns(runs, partCount, writeOrder<Kmer>);
+                writeParts(out, partCount, threadCount, [&](size_t part, PartBuffer &buffer){
+                    mergeRuns(runs, &bounds[part * threadCount], &bounds[(part + 1) * threadCount], writeOrder<Kmer>, [&](const Slot<Kmer> &slot){
+                        buffer.row(slot.data, slot.resOccurences, slot.susOccurences);
+                    });
+                });
+            }));
+            csv.bytes = std::filesystem::file_size(csvPath);
+            onThreads(threadCount, [&](size_t shard){
+                std::sort(counter->tables[shard]->slots, counter->tables[shard]->slots + runs.sizes[shard], valueOrder<Kmer>);
+            });
+            binary.ms.push_back(timeMs([&]{
+                CountsWriter<Kmer> writer(binaryPath, k, canonical ? COUNTS_FLAG_CANONICAL : 0, collection.genomes);
+                mergeRuns(runs, begins.data(), runs.sizes.data(), valueOrder<Kmer>, [&](const Slot<Kmer> &slot){
+                    writer.add(slot.data, slot.resOccurences, slot.susOccurences);
+                });
+                writer.close();
+            }));
+            binary.bytes = std::filesystem::file_size(binaryPath);
+            delete counter;
+        }
+        std::filesystem::remove(csvPath);
+        std::filesystem::remove(binaryPath);
+        results.add(count);
+        results.add(superKmers);
+        if (superDistinct != shardedDistinct || superChecksum != shardedChecksum) std::cout << "\tsuper-k-mers counted " << superDistinct << " kmers, sharded " << shardedDistinct << "\n";
+        results.add(sort);
+        results.add(merge);
+        std::cout << "\tchecksum " << mergeChecksum << "\n";
+        results.add(csv);
+        results.add(binary);
+    }
+}
+
+// "15,31,45" to {15, 31, 45}
+std::vector<size_t> numberList(const std::string &text){
+    std::vector<size_t> numbers;
+    std::stringstream ss(text);
+    std::string number;
+    while (std::getline(ss, number, ',')) {
+        numbers.push_back(std::stoul(number));
+    }
+    return numbers;
+}
+
+int benchSuite(const std::string &folder, const std::vector<size_t> &ks, const std::vector<size_t> &threadCounts, int repeats, bool canonical, const std::string &jsonPath){
+    Collection collection;
+    if (!loadCollection(folder, collection)){
+        std::cout << "no genomes in " << folder << " that are in its meta.csv\n";
+        return 1;
+    }
+    std::cout << collection.files.size() << " genomes, " << collection.bytes / MB << " MB, " << repeats << " repeats\n";
+    BenchResults results;
+    for (size_t k : ks) {
+        if (k < 1 || k > MAX_K){
+            std::cout << "k has to be between 1 and " << MAX_K << "\n";
+            return 1;
+        }
+        if (wordsFor(k) == 1) benchStages<KmerWord<1>::type>(collection, k, canonical, threadCounts, repeats, results);
+        else benchStages<KmerWord<2>::type>(collection, k, canonical, threadCounts, repeats, results);
+    }
+    if (!results.write(jsonPath, collection.files.size(), collection.bytes)){
+        std::cout << "couldn't write " << jsonPath << "\n";
+        return 1;
+    }
+    std::cout << "results written to " << jsonPath << "\n";
+    return 0;
+}
+
+// The value of "name": in a result line, without the quotes of a string
+std::string jsonField(const std::string &line, const std::string &name){
+    size_t at = line.find("\"" + name + "\": ");
+    if (at == std::string::npos) return "";
+    at += name.size() + 4;
+    if (line[at] == '"') return line.substr(at + 1, line.find('"', at + 1) - at - 1);
+    return line.substr(at, line.find_first_of(",}", at) - at);
+}
+
+std::map<std::string, double> readSuite(const std::string &path, std::vector<std::string> &order){
+    std::map<std::string, double> times;
+    std::ifstream in(path);
+    std::string line;
+    while (std::getline(in, line)){
+        if (line.find("\"bench\"") == std::string::npos) continue;
+        std::string variant = jsonField(line, "variant");
+        std::string key = jsonField(line, "bench") + (variant.empty() ? "" : "(" + variant + ")") + "\tk = " + jsonField(line, "k") + "\t" + jsonField(line, "threads") + " threads";
+        if (!times.count(key)) order.push_back(key);
+        times[key] = std::stod(jsonField(line, "ms"));
+    }
+    return times;
+}
+
+int benchCompare(const std::string &beforePath, const std::string &afterPath){
+    std::vector<std::string> order, afterOrder;
+    std::map<std::string, double> before = readSuite(beforePath, order);
+    std::map<std::string, double> after = readSuite(afterPath, afterOrder);
+    if (before.empty() || after.empty()){
+        std::cout << "no results in " << (before.empty() ? beforePath : afterPath) << "\n";
+        return 1;
+    }
+    std::cout << "stage\tk\tthreads\tbefore ms\tafter ms\tspeedup\n";
+    for (const std::string &key : order) {
+        if (!after.count(key)) continue;
+        std::cout << key << "\t" << before[key] << "\t" << after[key] << "\t" << before[key] / after[key] << "x\n";
+    }
+    return 0;
+}
+
+int main(int argc, char* argv[]){
+    std::string mode = argc > 1 ? argv[1] : "";
+    try{
+        if (mode == "encode" && argc > 2){
+            size_t k = argc > 3 ? std::stoul(argv[3]) : 31;
+            int repeats = argc > 4 ? std::stoi(argv[4]) : 10;
+            if (k < 1 || k > 31){
+                std::cout << "k has to be between 1 and 31\n";
+                return 1;
+            }
+            return benchEncode(argv[2], k, repeats);
+        }
+        if (mode == "generate" && argc > 2){
+            GeneratorSettings settings;
+            for (int j = 3; j + 1 < argc; j += 2) {
+                std::string option = argv[j];
+                if (option == "--genomes") settings.genomes = std::stoul(argv[j + 1]);
+                else if (option == "--length") settings.length = std::stoul(argv[j + 1]);
+                else if (option == "--gc") settings.gc = std::stod(argv[j + 1]);
+                else if (option == "--shared") settings.shared = std::stod(argv[j + 1]);
+                else if (option == "--contigs") settings.contigs = std::stoul(argv[j + 1]);
+                else if (option == "--resistant") settings.resistant = std::stod(argv[j + 1]);
+                else if (option == "--seed") settings.seed = std::stoull(argv[j + 1]);
+                else{
+                    std::cout << "unknown option " << option << "\n";
+                    return 1;
+                }
+            }
+            size_t bytes = generateGenomes(settings, argv[2]);
+            if (!bytes){
+                std::cout << "couldn't write the genomes to " << argv[2] << "\n";
+                return 1;
+            }
+            std::cout << "wrote " << settings.genomes << " genomes(" << bytes / MB << " MB) and meta.csv to " << argv[2] << "\n";
+            return 0;
+        }
+        if (mode == "suite" && argc > 2){
+            std::vector<size_t> ks = {15, 31, 45};
+            std::vector<size_t> threadCounts = {1, std::max<size_t>(1, std::thread::hardware_concurrency() / 2)};
+            int repeats = 3;
+            bool canonical = false;
+            std::string jsonPath = "bench.json";
+            for (int j = 3; j < argc; j++) {
+                std::string option = argv[j];
+                if (option == "--k" && j + 1 < argc) ks = numberList(argv[++j]);
+                else if (option == "--threads" && j + 1 < argc) threadCounts = numberList(argv[++j]);
+                else if (option == "--repeats" && j + 1 < argc) repeats = std::max(1, std::stoi(argv[++j]));
+                else if (option == "--canonical") canonical = true;
+                else if (option == "--json" && j + 1 < argc) jsonPath = argv[++j];
+                else{
+                    std::cout << "unknown option " << option << "\n";
+                    return 1;
+                }
+            }
+            threadCounts.erase(std::unique(threadCounts.begin(), threadCounts.end()), threadCounts.end());
+            if (std::count(threadCounts.begin(), threadCounts.end(), 0)){
+                std::cout << "threads have to be at least 1\n";
+                return 1;
+            }
+            return benchSuite(argv[2], ks, threadCounts, repeats, canonical, jsonPath);
+        }
+        if (mode == "compare" && argc == 4) return benchCompare(argv[2], argv[3]);
+    } catch (const std::exception &e){
+        std::cout << "didn't enter a number\n";
+        return 1;
+    }
+    std::cout << "usage: ./bench encode genome.fna [k] [repeats]\n"
+              << "       ./bench generate folder [--genomes N] [--length N] [--gc F] [--shared F] [--contigs N] [--resistant F] [--seed N]\n"
+              << "       ./bench suite folder [--k 15,31,45] [--threads 1,2,4] [--repeats N] [--canonical] [--json bench.json]\n"
+              << "       ./bench compare before.json after.json\n";
+    return 1;
+}
@@ -0,0 +1,118 @@
+/**
+ * Streams a file in fixed size chunks, for gzipped files, pipes and files that shouldn't be held in memory at once.
+ * A worker thread reads (and decompresses) the next chunks while the counting thread scans the current one, the two
+ * hand CHUNK_COUNT buffers back and forth so a stream never uses more than CHUNK_COUNT * CHUNK_SIZE bytes.
+ * zlib's gzread passes files that aren't compressed through as they are, so every streamed file goes through it.
+ *
+ * Chunks are cut wherever the buffer is full, readFile keeps its rolling kmer(the last k-1 bases) in a ScanState
+ * so kmers crossing a chunk boundary are still counted.
+ */
+
+#ifndef CHUNKREADER_H
+#define CHUNKREADER_H
+
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <zlib.h>
+
+#define CHUNK_SIZE (4 << 20) // 4 MB
+#define CHUNK_COUNT 3
+
+struct Chunk{
+    char *data;
+    size_t size;
+};
+
+class StreamedFile{
+public:
+    bool opened{};
+    std::string error; // set by the worker if the file turned out to be broken, check it once next() returns nullptr
+    size_t bytesRead{}; // decompressed bytes handed out so far
+
+    explicit StreamedFile(const std::string &path){
+        file = gzopen(path.c_str(), "rb");
+        if (!file) return;
+        opened = true;
+        gzbuffer(file, 1 << 17);
+        for (auto &chunk : chunks) {
+            chunk.data = new char[CHUNK_SIZE];
+            chunk.size = 0;
+        }
+        worker = std::thread(&StreamedFile::produce, this);
+    }
+    ~StreamedFile(){
+        if (!opened) return;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopped = true;
+        }
+        changed.notify_all();
+        worker.join();
+        gzclose(file);
+        for (auto &chunk : chunks) {
+            delete[] chunk.data;
+        }
+    }
+    StreamedFile(const StreamedFile&) = delete;
+    StreamedFile &operator=(const StreamedFile&) = delete;
+
+    // Hands out the next chunk and takes back the previous one, nullptr once the whole file has been read
+    const Chunk *next(){
+        std::unique_lock<std::mutex> lock(mutex);
+        if (holding){
+            released++;
+            holding = false;
+            changed.notify_all();
+        }
+        changed.wait(lock, [this]{ return produced > released || finished; });
+        if (produced == released) return nullptr;
+        holding = true;
+        const Chunk *chunk = &chunks[released % CHUNK_COUNT];
+        bytesRead += chunk->size;
+        return chunk;
+    }
+
+private:
+    gzFile file{};
+    Chunk chunks[CHUNK_COUNT]{};
+    std::mutex mutex;
+    std::condition_variable changed;
+    size_t produced{}; // chunks filled by the worker
+    size_t released{}; // chunks the counting thread is done with
+    bool holding{}; // the counting thread is scanning chunks[released % CHUNK_COUNT]
+    bool finished{};
+    bool stopped{}; // the counting thread gave up on the file
+    std::thread worker;
+
+    void produce(){
+        while (true){
+            Chunk *chunk;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                changed.wait(lock, [this]{ return produced - released < CHUNK_COUNT || stopped; });
+                if (stopped) break;
+                chunk = &chunks[produced % CHUNK_COUNT];
+            }
+            // the chunk belongs to this thread until produced gets bumped
+            int read = gzread(file, chunk->data, CHUNK_SIZE);
+            if (read <= 0){
+                // a truncated gzip file just ends, gzerror is the only thing that tells it apart from a complete one
+                int code;
+                const char *message = gzerror(file, &code);
+                if (code != Z_OK && code != Z_STREAM_END) error = message;
+                break;
+            }
+            chunk->size = read;
+            std::lock_guard<std::mutex> lock(mutex);
+            produced++;
+            changed.notify_all();
+        }
+        std::lock_guard<std::mutex> lock(mutex);
+        finished = true;
+        changed.notify_all();
+    }
+};
+
+#endif
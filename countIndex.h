@@ -0,0 +1,244 @@
+/**
+ * Count index(`./kmerCounter index counts.kmc counts.kidx`): the counts of a counts file laid out for looking single
+ * kmers up, for tools that want the counts of a few kmers or of the kmers of a sequence without reading all of
+ * counts.csv. counts.kmc is small but can only be read front to back, the index is bigger but is mapped and used as
+ * is: the kmers are a sorted array with a directory of their top bits(keyDirectory.h) in front, so a lookup reads one
+ * directory entry and binary searches a handful of keys, and res and sus are plain arrays next to them.
+ *
+ * This file is also the library side of the counter: include it, open a CountIndex and call find, nothing else of the
+ * program is needed. The query mode(queryServer.h) is built on the same calls.
+ *
+ * Layout(little endian, every section starts at a multiple of 4096):
+ *   header: "KMRI", uint32 version, uint32 k, uint32 flags(those of counts.kmc: 1 = canonical, 2 = filtered),
+ *           uint32 key bytes(8, or 16 for k > 32), uint32 directory bits, uint32 res files, uint32 sus files,
+ *           uint64 rows, uint64 directory offset, uint64 keys offset, uint64 res offset, uint64 sus offset
+ *   directory: 2^directory bits + 1 uint64, the first row of every value of the top bits of a kmer
+ *   keys: one kmer per row, sorted
+ *   res, sus: one uint32 per row
+ */
+
+#ifndef COUNTINDEX_H
+#define COUNTINDEX_H
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include "countsFile.h"
+#include "keyDirectory.h"
+#include "kmer.h"
+#include "mappedFile.h"
+
+#define INDEX_MAGIC "KMRI"
+#define INDEX_VERSION 1
+#define INDEX_ALIGN 4096
+
+struct IndexHeader{
+    char magic[4];
+    uint32_t version;
+    uint32_t k;
+    uint32_t flags;
+    uint32_t keyBytes;
+    uint32_t directoryBits;
+    uint32_t resAmount;
+    uint32_t susAmount;
+    uint64_t rows;
+    uint64_t directoryOffset;
+    uint64_t keysOffset;
+    uint64_t resOffset;
+    uint64_t susOffset;
+};
+
+// The nucleotides of a kmer, the first one in the highest bits. false if one of them isn't A, C, G or T
+template<typename Kmer>
+inline bool kmerOf(const char *text, size_t k, Kmer &kmer){
+    kmer = 0;
+    for (size_t i = 0; i < k; i++) {
+        Kmer code;
+        switch (text[i]) {
+            case 'a': case 'A': code = 0; break;
+            case 'c': case 'C': code = 1; break;
+            case 'g': case 'G': code = 2; break;
+            case 't': case 'T': code = 3; break;
+            default: return false;
+        }
+        kmer = (kmer << 2) | code;
+    }
+    return true;
+}
+
+// Only the header, main needs k to pick the kmer type before the index is opened
+inline bool readIndexHeader(const std::string &path, IndexHeader &header){
+    std::ifstream in(path, std::ios::binary);
+    return in.read(reinterpret_cast<char*>(&header), sizeof(IndexHeader)) && std::memcmp(header.magic, INDEX_MAGIC, 4) == 0;
+}
+
+// A count index mapped for lookups. Nothing changes after it's opened, any number of threads can look things up at once
+template<typename Kmer>
+class CountIndex{
+public:
+    IndexHeader header{};
+    std::string error; // empty if the file could be opened and looks like an index
+
+    explicit CountIndex(const std::string &path): file(path, false){
+        if (!file.opened || file.size < sizeof(IndexHeader)){
+            error = "couldn't open " + path;
+            return;
+        }
+        std::memcpy(&header, file.data, sizeof(IndexHeader));
+        const uint64_t rows = header.rows;
+        if (std::memcmp(header.magic, INDEX_MAGIC, 4) != 0 || header.version != INDEX_VERSION || header.k < 1 || header.k > MAX_K){
+            error = path + " isn't a count index";
+            return;
+        }
+        if (wordsFor(header.k) * 8 != sizeof(Kmer)){
+            error = path + " holds " + std::to_string(header.k) + "-mers, they don't fit this kmer type";
+            return;
+        }
+        if (header.keyBytes != sizeof(Kmer) || header.directoryBits < 1 || header.directoryBits > MAX_DIRECTORY_BITS
+            || header.directoryBits > 2 * header.k || !fits(header.directoryOffset, KeyDirectory<Kmer>::entriesFor(header.directoryBits) * 8)
+            || !fits(header.keysOffset, rows * sizeof(Kmer)) || !fits(header.resOffset, rows * 4) || !fits(header.susOffset, rows * 4)){
+            error = path + " is truncated or broken";
+            return;
+        }
+        directory = KeyDirectory<Kmer>(header.k, header.directoryBits, reinterpret_cast<const uint64_t*>(file.data + header.directoryOffset));
+        keys = reinterpret_cast<const Kmer*>(file.data + header.keysOffset);
+        res = reinterpret_cast<const uint32_t*>(file.data + header.resOffset);
+        sus = reinterpret_cast<const uint32_t*>(file.data + header.susOffset);
+        mask = kmerMaskOf<Kmer>(header.k);
+    }
+
+    bool canonical() const{
+        return header.flags & COUNTS_FLAG_CANONICAL;
+    }
+
+    // The counts of a kmer as it was counted, so the lower of it and its reverse complement if the index is canonical.
+    // false(and 0, 0) if it isn't in any genome, or was filtered out of counts.kmc
+    bool lookup(Kmer kmer, uint32_t &resCount, uint32_t &susCount) const{
+        size_t row = directory.rowOf(keys, header.rows, kmer & mask);
+        if (row == header.rows){
+            resCount = susCount = 0;
+            return false;
+        }
+        resCount = res[row];
+        susCount = sus[row];
+        return true;
+    }
+
+    // The counts of any kmer, it's turned into its canonical form first where needed
+    bool find(Kmer kmer, uint32_t &resCount, uint32_t &susCount) const{
+        kmer &= mask;
+        if (canonical()) kmer = std::min(kmer, reverseComplementOf(kmer, header.k));
+        return lookup(kmer, resCount, susCount);
+    }
+
+    // The counts of the k nucleotides at text, false if they aren't all A, C, G or T or the kmer isn't there
+    bool find(const char *text, uint32_t &resCount, uint32_t &susCount) const{
+        Kmer kmer;
+        if (!kmerOf(text, header.k, kmer)){
+            resCount = susCount = 0;
+            return false;
+        }
+        return find(kmer, resCount, susCount);
+    }
+
+private:
+    MappedFile file;
+    KeyDirectory<Kmer> directory;
+    const Kmer *keys{};
+    const uint32_t *res{};
+    const uint32_t *sus{};
+    Kmer mask{};
+
+    // A section is aligned for its type and inside the file
+    bool fits(uint64_t offset, uint64_t bytes) const{
+        return offset % INDEX_ALIGN == 0 && offset <= file.size && bytes <= file.size - offset;
+    }
+};
+
+// Decodes counts.kmc straight into the mapped index file, the directory is filled in as the sorted keys go by
+template<typename Kmer>
+bool buildIndex(const CountsFile &counts, const std::string &path){
+    const CountsHeader &countsHeader = counts.header;
+    const uint64_t rows = countsHeader.kmerCount;
+    IndexHeader header = {{'K', 'M', 'R', 'I'}, INDEX_VERSION, countsHeader.k, countsHeader.flags, sizeof(Kmer),
+                          KeyDirectory<Kmer>::bitsFor(rows, countsHeader.k), countsHeader.resAmount, countsHeader.susAmount, rows, 0, 0, 0, 0};
+    header.directoryOffset = alignedTo(sizeof(IndexHeader), INDEX_ALIGN);
+    header.keysOffset = alignedTo(header.directoryOffset + KeyDirectory<Kmer>::entriesFor(header.directoryBits) * 8, INDEX_ALIGN);
+    header.resOffset = alignedTo(header.keysOffset + rows * sizeof(Kmer), INDEX_ALIGN);
+    header.susOffset = alignedTo(header.resOffset + rows * 4, INDEX_ALIGN);
+    const uint64_t size = header.susOffset + rows * 4;
+    int fd = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0){
+        std::cout << "couldn't create " << path << "\n";
+        return false;
+    }
+    if (ftruncate(fd, static_cast<off_t>(size)) != 0){
+        std::cout << "couldn't make " << path << " " << (size >> 20) << " MB big\n";
+        close(fd);
+        return false;
+    }
+    void *mapping = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED){
+        std::cout << "couldn't map " << path << "\n";
+        return false;
+    }
+    char *data = static_cast<char*>(mapping);
+    std::memcpy(data, &header, sizeof(IndexHeader));
+    auto *starts = reinterpret_cast<uint64_t*>(data + header.directoryOffset);
+    auto *keys = reinterpret_cast<Kmer*>(data + header.keysOffset);
+    auto *res = reinterpret_cast<uint32_t*>(data + header.resOffset);
+    auto *sus = reinterpret_cast<uint32_t*>(data + header.susOffset);
+    KeyDirectory<Kmer> directory(header.k, header.directoryBits, starts);
+    const Kmer mask = kmerMaskOf<Kmer>(header.k);
+    auto *reader = new CountsReader<Kmer>(counts);
+    uint64_t row = 0;
+    bool ok = true;
+    while (ok && reader->next()){
+        if (rows - row < reader->blockSize){
+            ok = false;
+            break;
+        }
+        for (size_t i = 0; i < reader->blockSize && ok; i++) {
+            // a key past 4^k would point past the directory
+            ok = reader->keys[i] <= mask;
+            if (ok) directory.add(starts, reader->keys[i], row + i);
+        }
+        std::memcpy(keys + row, reader->keys, reader->blockSize * sizeof(Kmer));
+        std::memcpy(res + row, reader->res, reader->blockSize * 4);
+        std::memcpy(sus + row, reader->sus, reader->blockSize * 4);
+        row += reader->blockSize;
+    }
+    ok = ok && !reader->broken && row == rows;
+    delete reader;
+    directory.finish(starts, rows);
+    ok = msync(data, size, MS_SYNC) == 0 && ok;
+    munmap(data, size);
+    return ok;
+}
+
+// counts.kmc -> count index
+inline bool indexCounts(const std::string &path, const std::string &outPath){
+    CountsFile counts(path);
+    if (!counts.error.empty()){
+        std::cout << counts.error << "\n";
+        return false;
+    }
+    const CountsHeader &header = counts.header;
+    std::cout << header.k << "-mers" << (counts.canonical() ? "(canonical)" : "") << " from " << header.resAmount
+              << " resistant and " << header.susAmount << " susceptible genomes, " << header.kmerCount << " kmers\n";
+    bool ok = wordsFor(header.k) == 1 ? buildIndex<KmerWord<1>::type>(counts, outPath)
+                                      : buildIndex<KmerWord<2>::type>(counts, outPath);
+    if (!ok){
+        std::cout << path << " is truncated or broken, or " << outPath << " couldn't be written\n";
+        std::remove(outPath.c_str());
+    }
+    return ok;
+}
+
+#endif
@@ -0,0 +1,846 @@
+/**
+ * The counting pipeline, everything between the settings and the files it writes. main only turns the command line
+ * (or the prompts) into Settings and calls countGenomes, other programs can include this and do the same:
+ *
+ *   Settings settings;
+ *   settings.folder = "genomes";
+ *   settings.k = 31;
+ *   settings.binary = true;
+ *   CountStatus status = countGenomes(settings);
+ *
+ * A GenomeCounter holds what a run keeps track of(the --stats it collects and the phenotypes of several
+ * antibiotics), so runs don't share anything and can follow each other in one program. What the run does is printed
+ * as it goes, like the command line does.
+ */
+
+#ifndef COUNTER_H
+#define COUNTER_H
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <numeric>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+#include "kmer.h"
+#include "kmerTable.h"
+#include "denseCounter.h"
+#include "shards.h"
+#include "mappedFile.h"
+#include "chunkReader.h"
+#include "fastaScanner.h"
+#include "countsFile.h"
+#include "outputWriter.h"
+#include "filters.h"
+#include "diskBins.h"
+#include "database.h"
+#include "fileQueue.h"
+#include "stats.h"
+#include "sortedRuns.h"
+#include "presenceFile.h"
+#include "metadata.h"
+#include "superKmers.h"
+
+#define MB 1048576.0
+
+// What the user asked for on the command line
+struct Settings{
+    std::string folder; // the genomes and meta.csv
+    int threadCount = 1;
+    size_t k{};
+    size_t denseMemory = DEFAULT_DENSE_MEMORY; // MB, every kmer gets its own slot when 4^k slots per thread fit into this(--dense-mem)
+    std::string databasePath; // count the genomes that aren't in this counts file yet into it(add)
+    bool useMmap = true; // map the fasta files instead of reading them into a buffer(--ifstream turns it off)
+    bool stream = false; // stream every file in chunks, not just the gzipped ones(--stream)
+    bool canonical = false; // a kmer and its reverse complement count as one(--canonical)
+    bool binary = false; // write counts.kmc instead of counts.csv(--binary)
+    std::string binaryPath = "counts.kmc";
+    bool unsorted = false; // write counts.csv in whatever order the kmers are in, skips sorting(--unsorted)
+    uint32_t minPresence = 1; // only write kmers that are in at least this many genomes(--min-presence)
+    uint32_t minDiff = 0; // and whose |res - sus| is at least this(--min-diff)
+    double maxP = 1; // and whose p value is at most this(--max-p)
+    Test test = Test::fisher; // the test the p value comes from(--test fisher/chi2)
+    bool twoPass = false; // count in how many genomes kmers are first, to leave out the rare ones(--two-pass)
+    size_t bloomMemory = DEFAULT_BLOOM_MEMORY; // MB for the first pass(--bloom-mem)
+    size_t maxMemory = 0; // MB, count through bin files on disk to stay below this, 0 counts in memory(--max-mem)
+    std::string tmpFolder = "counts.tmp"; // where the bin files go(--tmp-dir)
+    bool superKmers = false; // group the kmers into minimizer buckets and count those one at a time(--super-kmers)
+    std::string statsPath; // write the time every phase took and such as JSON here(--stats)
+    std::string presencePath; // write which genomes every kmer is in here(--presence)
+    std::string metaPath; // folder/meta.csv unless --meta says otherwise
+    std::string idColumn = "2"; // the genome id column of meta.csv, a number from 1 or a name(--id-column)
+    std::string phenotypeColumn = "5"; // and the resistant/susceptible column(--phenotype-column)
+    std::vector<std::string> phenotypeColumns; // a resistant/susceptible column per antibiotic(--phenotype-columns)
+    std::string antibioticColumn; // meta.csv has a row per genome and antibiotic(--antibiotic-column)
+    const PhenotypeSet *phenotypes = nullptr; // only with several phenotypes, the kmers are counted per antibiotic
+};
+
+enum class CountStatus{
+    written, // the counts and everything else that was asked for are written
+    nothingNew, // add found no genomes that aren't in the database yet
+    invalid, // the settings don't go together, or the folder or meta.csv couldn't be read. Nothing was counted
+    failed // an output couldn't be written
+};
+
+inline std::ofstream openCountsFile(const Settings &settings){
+    std::ofstream kmersFile;
+    kmersFile.open("counts.csv");
+    kmersFile << settings.k << "-mer(" << (settings.canonical ? "canonical, the lower of the kmer and its reverse complement; " : "")
+              << "convert to binary (2*k) to get nucleotides; 00=A,01=C,10=G,11=T)";
+    if (!settings.phenotypes) kmersFile << ",res,sus";
+    else for (const std::string &name : settings.phenotypes->names) {
+        kmersFile << "," << name << " res," << name << " sus";
+    }
+    kmersFile << "\n";
+    return kmersFile;
+}
+
+// A full disk or a path that can't be written to shows up when the file is closed
+inline bool writingDone(bool written, const std::string &path){
+    if (written) std::cout << "writing done\n";
+    else std::cout << "couldn't write " << path << "\n";
+    return written;
+}
+
+inline uint32_t countsFlags(const Settings &settings){
+    bool filtered = settings.minPresence > 1 || settings.minDiff > 0 || settings.maxP < 1;
+    return (settings.canonical ? COUNTS_FLAG_CANONICAL : 0) | (filtered ? COUNTS_FLAG_FILTERED : 0);
+}
+
+// Gzipped files and pipes can't be mapped, they're streamed in chunks. --stream does the same for every file
+inline bool isStreamed(const Settings &settings, const std::filesystem::directory_entry &file){
+    if (settings.stream || !file.is_regular_file()) return true;
+    return file.path().extension() == ".gz";
+}
+
+// Reads one genome into the counter and returns how many bytes that was. Counter is a DenseCounter, one of the
+// routers or a PieceFilter in front of them
+template<typename Counter>
+size_t readGenome(const Settings &settings, const GenomeFile &file, char *&buffer, size_t &bufferSize, Counter *table){
+    const size_t k = settings.k;
+    std::string fileName = file.entry.path().string();
+    ScanState<typename Counter::Kmer> state;
+    if (file.streamed){
+        StreamedFile genome(fileName);
+        if (!genome.opened){
+            std::cout << "couldn't open " << fileName << "\n";
+            return 0;
+        }
+        while (const Chunk *chunk = genome.next()){
+            readFile(k, settings.canonical, chunk->size, file.fileNr, file.resistant, state, chunk->data, table);
+        }
+        if (!genome.error.empty()) std::cout << "error reading " << fileName << ": " << genome.error << "\n";
+        return genome.bytesRead;
+    }
+    if (settings.useMmap){
+        // the pages are scanned right where they're mapped
+        MappedFile genome(fileName);
+        if (!genome.opened) std::cout << "couldn't open " << fileName << "\n";
+        else readFile(k, settings.canonical, genome.size, file.fileNr, file.resistant, state, genome.data, table);
+        return genome.size;
+    }
+    std::ifstream genomeFile(fileName);
+
+    // Read how many bytes the file is
+    genomeFile.seekg(0, std::ios::end);
+    auto fileSize = genomeFile.tellg();
+    if (fileSize > bufferSize){
+        bufferSize = (size_t) fileSize << 1;
+        delete[] buffer;
+        buffer = new char[bufferSize];
+    }
+    genomeFile.seekg(0, std::ios::beg);
+    genomeFile.read(buffer, fileSize);
+    readFile(k, settings.canonical, fileSize, file.fileNr, file.resistant, state, buffer, table);
+    return fileSize;
+}
+
+// Drops the kmers the filters don't want and sorts the rest the way they're going to be written, returns how many are left.
+// With several phenotypes a kmer stays if any antibiotic's filter lets it through
+template<typename Kmer>
+size_t prepareRun(Slot<Kmer> *slots, size_t count, const Settings &settings, const KmerFilter *filter, const PhenotypeCounters *phenotypes = nullptr){
+    if (phenotypes){
+        if (phenotypes->set.filtered()){
+            count = std::remove_if(slots, slots + count, [&](const Slot<Kmer> &slot){
+                return !phenotypes->set.passes(phenotypes->row(slot.flags));
+            }) - slots;
+        }
+        if (!settings.unsorted) std::sort(slots, slots + count, valueOrder<Kmer>);
+        return count;
+    }
+    if (filter->active()){
+        count = std::remove_if(slots, slots + count, [&](const Slot<Kmer> &slot){
+            return !filter->passes(slot.resOccurences, slot.susOccurences);
+        }) - slots;
+    }
+    if (settings.binary) std::sort(slots, slots + count, valueOrder<Kmer>);
+    else if (!settings.unsorted) std::sort(slots, slots + count, writeOrder<Kmer>);
+    return count;
+}
+
+// One run of the pipeline
+class GenomeCounter{
+public:
+    GenomeCounter() = default;
+    ~GenomeCounter(){
+        delete stats;
+        delete phenotypes;
+    }
+    GenomeCounter(const GenomeCounter&) = delete;
+    GenomeCounter &operator=(const GenomeCounter&) = delete;
+
+    // Scans the folder, matches the genomes to meta.csv and counts them the way settings asks for
+    CountStatus count(Settings settings){
+        const std::string folder = settings.folder;
+        const size_t k = settings.k;
+        const int threadCount = settings.threadCount;
+        const std::string databasePath = settings.databasePath;
+        size_t denseMemory = settings.denseMemory;
+        if (k < 1 || k > MAX_K || threadCount < 1){
+            std::cout << "k has to be between 1 and " << MAX_K << " and there has to be a thread at least\n";
+            return CountStatus::invalid;
+        }
+        const size_t kmerMax = k < 32 ? (size_t) 1 << (2 * k) : 0; // number of kmer combinations(4^k), 0 when that doesn't fit into a size_t
+        if (!settings.statsPath.empty()) stats = new RunStats();
+        std::unordered_set<std::string> counted; // genomes that are in the database already, or have been seen in the folder
+        if (!databasePath.empty() && !settings.presencePath.empty()){
+            std::cout << "--presence can't be used with add, the matrix would only have the new genomes\n";
+            return CountStatus::invalid;
+        }
+        const bool severalPhenotypes = settings.phenotypeColumns.size() > 1 || !settings.antibioticColumn.empty();
+        if (!settings.phenotypeColumns.empty() && !settings.antibioticColumn.empty()){
+            std::cout << "use either --phenotype-columns or --antibiotic-column, not both\n";
+            return CountStatus::invalid;
+        }
+        if (severalPhenotypes && (!databasePath.empty() || settings.maxMemory)){
+            std::cout << "several phenotypes can't be counted " << (settings.maxMemory ? "with --max-mem" : "into a database with add") << "\n";
+            return CountStatus::invalid;
+        }
+        if (severalPhenotypes && settings.binary){
+            std::cout << "counts.kmc only holds one phenotype, writing counts.csv\n";
+            settings.binary = false;
+        }
+        if (!databasePath.empty()){
+            // the new genomes are counted into a file of their own and merged in afterwards
+            settings.binary = true;
+            settings.binaryPath = databasePath + ".new";
+            if (std::filesystem::exists(databasePath)){
+                CountsFile database(databasePath);
+                CountsHeader header{};
+                std::memcpy(header.magic, COUNTS_MAGIC, 4);
+                header.version = COUNTS_VERSION;
+                header.k = k;
+                header.flags = countsFlags(settings);
+                std::string problem = database.error.empty() ? mergeProblem(database.header, header) : database.error;
+                if (!problem.empty()){
+                    std::cout << "can't add to " << databasePath << ": " << problem << "\n";
+                    return CountStatus::invalid;
+                }
+                counted.insert(database.genomes.ids.begin(), database.genomes.ids.end());
+                std::cout << databasePath << " has " << counted.size() << " genomes\n";
+            }
+            else if (countsFlags(settings) & COUNTS_FLAG_FILTERED){
+                std::cout << "can't add to " << databasePath << ": filtered counts can't be added to\n";
+                return CountStatus::invalid;
+            }
+        }
+        std::vector<GenomeFile> genomeFiles; // handed out to the threads biggest first by the FileQueue
+        uint32_t fileNr = 1;
+        int i;
+        GenomeList genomes;
+        size_t skipped = 0;
+        if (settings.metaPath.empty()) settings.metaPath = folder + "/meta.csv";
+        if (settings.phenotypeColumns.empty()) settings.phenotypeColumns.push_back(settings.phenotypeColumn);
+        Metadata metadata(settings.metaPath, settings.idColumn, settings.phenotypeColumns, settings.antibioticColumn);
+        if (!metadata.error.empty()){
+            std::cout << metadata.error << "\n";
+            return CountStatus::invalid;
+        }
+        endPhase("metadata");
+        if (severalPhenotypes) phenotypes = new PhenotypeSet(metadata.antibiotics);
+        for (const auto &entry: std::filesystem::directory_iterator(folder)){
+            std::string fileName = entry.path().filename().string();
+            if (fileName == "meta.csv" || fileName == "downloaded.csv" || fileName == "counts.csv" || fileName == "counts.kmc") continue;
+            if (entry.path() == std::filesystem::path(settings.metaPath)) continue;
+            // genome.fna.gz has the same id as genome.fna
+            std::string genomeId = genomeIdOf(fileName);
+            const GenomeMetadata *genome = metadata.match(genomeId, fileName);
+            if (!genome) continue;
+            if (!databasePath.empty() && !counted.insert(genomeId).second){
+                skipped++;
+                continue;
+            }
+            // with several phenotypes the slots count every genome as resistant, which makes res the genomes a kmer is in
+            bool resistant = phenotypes || genome->phenotypes[0] == 1;
+            genomes.add(genomeId, resistant);
+            if (phenotypes) phenotypes->addGenome(genome->phenotypes);
+
+            std::error_code sizeError;
+            size_t size = entry.is_regular_file() ? entry.file_size(sizeError) : 0;
+            if (entry.path().extension() == ".gz") size *= 4;
+            genomeFiles.push_back({entry, resistant, fileNr++, size, isStreamed(settings, entry)});
+        }
+        metadata.report();
+        if (stats){
+            stats->value("metadata_rows", metadata.rows);
+            stats->value("unmatched_files", metadata.unmatchedFileCount);
+        }
+        if (!databasePath.empty()){
+            if (skipped) std::cout << "skipped " << skipped << " genomes that are already in " << databasePath << " or in the folder twice\n";
+            if (genomes.ids.empty()){
+                std::cout << "no new genomes to add\n";
+                return CountStatus::nothingNew;
+            }
+        }
+        if (phenotypes){
+            if (genomes.ids.size() > MAX_PHENOTYPE_GENOMES){
+                std::cout << "several phenotypes can be counted for at most " << MAX_PHENOTYPE_GENOMES << " genomes\n";
+                return CountStatus::invalid;
+            }
+            phenotypes->addFilters(settings.minPresence, settings.minDiff, settings.maxP, settings.test);
+            settings.phenotypes = phenotypes;
+            if (stats) stats->value("antibiotics", phenotypes->names.size());
+        }
+        FileQueue queue(std::move(genomeFiles), threadCount);
+        const size_t fileSize = queue.largestTask;
+        endPhase("scan");
+        if (settings.maxMemory) denseMemory = std::min(denseMemory, settings.maxMemory);
+        KmerFilter filter(settings.minPresence, settings.minDiff, settings.maxP, settings.test, genomes.resAmount, genomes.susAmount);
+        // the dense counters have no room for the counters of several phenotypes
+        bool dense = !phenotypes && kmerMax && fitsDenseBudget(kmerMax, threadCount, denseMemory);
+        if (settings.superKmers && (dense || phenotypes)){
+            std::cout << "--super-kmers is only used by the hash tables with one phenotype, counting without it\n";
+            settings.superKmers = false;
+        }
+        if (settings.twoPass && settings.superKmers){
+            // the bucket tables are small anyway, leaving rare kmers out of them wouldn't save anything
+            std::cout << "--two-pass isn't used together with --super-kmers, counting in one pass\n";
+            settings.twoPass = false;
+        }
+        if (settings.twoPass && settings.maxMemory && !dense){
+            std::cout << "--two-pass isn't used together with --max-mem, counting in one pass\n";
+            settings.twoPass = false;
+        }
+        if (settings.twoPass && (dense || settings.minPresence < 2)){
+            // the dense counters have a slot for every kmer anyway, and without --min-presence nothing could be left out
+            std::cout << "--two-pass only helps the hash tables with --min-presence 2 or more, counting in one pass\n";
+            settings.twoPass = false;
+        }
+        bool written;
+        if (dense){
+            // one dense counter per thread when k is small enough
+            std::cout << "using dense counters(" << (kmerMax * sizeof(DenseSlot) * threadCount) / MB << " MB)\n";
+            auto *threads = new std::thread[threadCount];
+            auto **counters = new DenseCounter *[threadCount];
+            for (i = 0; i < threadCount; i++) {
+                counters[i] = new DenseCounter(kmerMax);
+                threads[i] = std::thread([&, i]{ readFiles(settings, fileSize << 1, queue, counters[i]); });
+            }
+            for (i = 0; i < threadCount; i++)
+                threads[i].join();
+            endPhase("count");
+            written = writeToFile(counters, threadCount, settings, filter, genomes);
+            if (written && !settings.presencePath.empty()){
+                // the kmers that are left in the merged counter are the ones that were written, in order already
+                const DenseCounter *merged = counters[0];
+                size_t rows = 0;
+                for (size_t j = 0; j < merged->size; j++) {
+                    rows += (merged->slots[j].resOccurences | merged->slots[j].susOccurences) != 0;
+                }
+                written = writePresence<size_t>(settings, threadCount, queue, genomes, rows, [&](size_t *keys){
+                    for (size_t j = 0; j < merged->size; j++) {
+                        if (merged->slots[j].resOccurences | merged->slots[j].susOccurences) *keys++ = j;
+                    }
+                });
+            }
+            for (int j = 0; j < threadCount; j++) {
+                delete counters[j];
+            }
+            delete[] counters;
+            delete[] threads;
+        }
+        else if (wordsFor(k) == 1) written = countSharded<KmerWord<1>::type>(settings, threadCount, queue, filter, genomes);
+        else written = countSharded<KmerWord<2>::type>(settings, threadCount, queue, filter, genomes);
+        if (!databasePath.empty()){
+            if (!written){
+                // a short counts file would take genomes into the database without all of their kmers
+                std::error_code removeError;
+                std::filesystem::remove(settings.binaryPath, removeError);
+                std::cout << databasePath << " was left as it was\n";
+            }
+            else if (!addToDatabase(databasePath, settings.binaryPath)){
+                std::cout << "couldn't add the new genomes to " << databasePath << "\n";
+                written = false;
+            }
+            endPhase("merge database");
+        }
+        if (stats){
+            stats->value("k", k);
+            stats->value("threads", threadCount);
+            stats->value("genomes", genomes.ids.size());
+            stats->value("resistant", genomes.resAmount);
+            stats->value("susceptible", genomes.susAmount);
+            stats->value("dense", dense);
+            if (dense) stats->value("dense_mb", kmerMax * sizeof(DenseSlot) * threadCount / MB);
+            if (!stats->write(settings.statsPath)) std::cout << "couldn't write " << settings.statsPath << "\n";
+        }
+        return written ? CountStatus::written : CountStatus::failed;
+    }
+
+private:
+    RunStats *stats{}; // only with --stats
+    PhenotypeSet *phenotypes{}; // only with several phenotypes
+
+    void endPhase(const char *name){
+        if (stats) stats->endPhase(name);
+    }
+
+    // For --stats, call before compact
+    template<typename Kmer>
+    void tableStats(const std::string &name, const KmerTable<Kmer> &table){
+        if (!stats) return;
+        size_t longest;
+        size_t total = table.probeLengths(longest);
+        stats->table(name, table.capacity, table.count, table.grows, table.growMs, total, longest);
+    }
+
+    // The runs have been filtered and sorted by the threads that counted them, the parts of the output are merged from
+    // the runs and formatted on every thread. false if the file couldn't be written
+    template<typename Kmer>
+    bool writeToFile(const SortedRuns<Kmer> &runs, const size_t threadCount, const Settings &settings, const GenomeList &genomes){
+        std::cout << "started writing\n";
+        const size_t runCount = runs.count();
+        if (settings.binary){
+            // the keys are delta encoded one after the other, this stays on one thread
+            CountsWriter<Kmer> writer(settings.binaryPath, settings.k, countsFlags(settings), genomes);
+            std::vector<size_t> begins(runCount, 0);
+            mergeRuns(runs, begins.data(), runs.sizes.data(), valueOrder<Kmer>, [&](const Slot<Kmer> &slot){
+                writer.add(slot.data, slot.resOccurences, slot.susOccurences);
+            });
+            if (stats) stats->value("kmers_written", std::accumulate(runs.sizes.begin(), runs.sizes.end(), (size_t) 0));
+            endPhase("write");
+            return writingDone(writer.close(), settings.binaryPath);
+        }
+        std::ofstream kmersFile = openCountsFile(settings);
+        size_t partCount;
+        // with several phenotypes there's no one difference to order by, the kmers are written in value order
+        std::vector<size_t> bounds = settings.unsorted ? cutRuns(runs, partCount)
+                                   : settings.phenotypes ? splitRuns(runs, partCount, valueOrder<Kmer>) : splitRuns(runs, partCount, writeOrder<Kmer>);
+        endPhase("split");
+        writeParts(kmersFile, partCount, threadCount, [&](size_t part, PartBuffer &buffer){
+            const size_t *begins = &bounds[part * runCount], *ends = &bounds[(part + 1) * runCount];
+            if (settings.phenotypes) mergeRuns(runs, begins, ends, valueOrder<Kmer>, [&](const Slot<Kmer> &slot, size_t run){
+                buffer.row(slot.data, runs.phenotypes[run]->row(slot.flags), settings.phenotypes->width());
+            });
+            else mergeRuns(runs, begins, ends, writeOrder<Kmer>, [&](const Slot<Kmer> &slot){
+                buffer.row(slot.data, slot.resOccurences, slot.susOccurences);
+            });
+        });
+        kmersFile.close();
+        if (stats) stats->value("kmers_written", std::accumulate(runs.sizes.begin(), runs.sizes.end(), (size_t) 0));
+        endPhase("write");
+        return writingDone(!kmersFile.fail(), "counts.csv");
+    }
+
+    // Same order as the hash table output. The kmers are already sorted by value in the array, so a counting sort on the
+    // res/sus difference gives the final order without comparing anything. Every thread sums up and counts its own slice
+    // of the array, the slices of one difference follow each other in the sorted array so the order stays the same.
+    bool writeToFile(DenseCounter **counters, const size_t threadCount, const Settings &settings, const KmerFilter &filter, const GenomeList &genomes){
+        std::cout << "started writing\n";
+        DenseCounter *merged = counters[0];
+        const size_t size = merged->size;
+        const size_t buckets = std::max(genomes.resAmount, genomes.susAmount) + 1;
+        // bucketStarts[thread * buckets + d] is where the kmers of the thread's slice with a difference of d start in the
+        // sorted array, biggest difference first
+        auto *bucketStarts = new size_t[threadCount * buckets]();
+        onThreads(threadCount, [&](size_t thread){
+            size_t begin = size * thread / threadCount, end = size * (thread + 1) / threadCount;
+            for (size_t i = 1; i < threadCount; i++) {
+                merged->add(*counters[i], begin, end);
+            }
+            size_t *bucketSizes = bucketStarts + thread * buckets;
+            for (size_t i = begin; i < end; i++) {
+                DenseSlot &slot = merged->slots[i];
+                if ((slot.resOccurences | slot.susOccurences) == 0) continue;
+                if (!filter.passes(slot.resOccurences, slot.susOccurences)){
+                    // filtered kmers look like they were never seen to everything after this
+                    slot.resOccurences = 0;
+                    slot.susOccurences = 0;
+                    continue;
+                }
+                uint32_t diff = slot.resOccurences > slot.susOccurences ? slot.resOccurences - slot.susOccurences : slot.susOccurences - slot.resOccurences;
+                bucketSizes[diff]++;
+            }
+        });
+        for (size_t i = 1; i < threadCount; i++) {
+            delete counters[i];
+            counters[i] = nullptr;
+        }
+        endPhase("merge");
+        size_t kmerCount = 0;
+        for (size_t d = buckets; d-- > 0; ) {
+            for (size_t thread = 0; thread < threadCount; thread++) {
+                size_t bucketSize = bucketStarts[thread * buckets + d];
+                bucketStarts[thread * buckets + d] = kmerCount;
+                kmerCount += bucketSize;
+            }
+        }
+        if (stats) stats->value("kmers_written", kmerCount);
+        if (settings.binary){
+            // the array is already in kmer order
+            CountsWriter<size_t> writer(settings.binaryPath, settings.k, countsFlags(settings), genomes);
+            for (size_t i = 0; i < size; i++) {
+                const DenseSlot &slot = merged->slots[i];
+                if ((slot.resOccurences | slot.susOccurences) == 0) continue;
+                writer.add(i, slot.resOccurences, slot.susOccurences);
+            }
+            delete[] bucketStarts;
+            endPhase("write");
+            return writingDone(writer.close(), settings.binaryPath);
+        }
+        std::ofstream kmersFile = openCountsFile(settings);
+        const size_t partCount = (kmerCount + PART_KMERS - 1) / PART_KMERS;
+        if (settings.unsorted){
+            // parts are slices of the array, they hold PART_KMERS rows on average
+            writeParts(kmersFile, partCount, threadCount, [&](size_t part, PartBuffer &buffer){
+                for (size_t i = size * part / partCount; i < size * (part + 1) / partCount; i++) {
+                    const DenseSlot &slot = merged->slots[i];
+                    if ((slot.resOccurences | slot.susOccurences) == 0) continue;
+                    buffer.row(i, slot.resOccurences, slot.susOccurences);
+                }
+            });
+        }
+        else{
+            auto *sorted = new size_t[kmerCount];
+            onThreads(threadCount, [&](size_t thread){
+                size_t *bucketOffsets = bucketStarts + thread * buckets;
+                for (size_t i = size * thread / threadCount; i < size * (thread + 1) / threadCount; i++) {
+                    const DenseSlot &slot = merged->slots[i];
+                    if ((slot.resOccurences | slot.susOccurences) == 0) continue;
+                    uint32_t diff = slot.resOccurences > slot.susOccurences ? slot.resOccurences - slot.susOccurences : slot.susOccurences - slot.resOccurences;
+                    sorted[bucketOffsets[diff]++] = i;
+                }
+            });
+            endPhase("sort");
+            writeParts(kmersFile, partCount, threadCount, [&](size_t part, PartBuffer &buffer){
+                for (size_t i = part * PART_KMERS; i < std::min(kmerCount, (part + 1) * PART_KMERS); i++) {
+                    const DenseSlot &slot = merged->slots[sorted[i]];
+                    buffer.row(sorted[i], slot.resOccurences, slot.susOccurences);
+                }
+            });
+            delete[] sorted;
+        }
+        delete[] bucketStarts;
+        kmersFile.close();
+        endPhase("write");
+        return writingDone(!kmersFile.fail(), "counts.csv");
+    }
+
+    // Takes files off the queue until there are none left, Counter is a DenseCounter or one of the routers
+    template<typename Counter>
+    void readFiles(const Settings &settings, const size_t initialBufferSize, FileQueue &queue, Counter *table){
+        auto start = std::chrono::high_resolution_clock::now();
+        size_t bufferSize = settings.useMmap ? 0 : initialBufferSize;
+        char *buffer = new char[bufferSize];
+        size_t bytesRead = 0;
+        size_t filesRead = 0;
+        size_t pieces = 0;
+        size_t streamed = 0;
+        while (const FileTask *task = queue.next()){
+            const GenomeFile &file = *task->file;
+            if (task->pieces > 1){
+                PieceFilter<Counter> piece(table, task->piece, task->pieces);
+                bytesRead += readGenome(settings, file, buffer, bufferSize, &piece);
+                pieces++;
+            }
+            else bytesRead += readGenome(settings, file, buffer, bufferSize, table);
+            filesRead++;
+            streamed += file.streamed;
+        }
+        // Calculate and display how long the files were read for and how fast that was
+        auto stop = std::chrono::high_resolution_clock::now();
+        auto duration = std::chrono::duration_cast<std::chrono::nanoseconds>(stop - start);
+        double ms = duration.count() / 1000000.0;
+        std::ostringstream report; // one write so the lines of different threads don't get mixed up
+        report << "read " << filesRead << " files(" << pieces << " pieces of split files, " << streamed << " streamed, "
+               << bytesRead / MB << " MB, " << (settings.useMmap ? "mmap" : "ifstream") << ") in " << ms << " ms, "
+               << (ms > 0 ? bytesRead / MB / (ms / 1000.0) : 0) << " MB/s\n";
+        std::cout << report.str();
+        if (stats) stats->reader({filesRead, pieces, streamed, bytesRead, ms});
+        delete[] buffer;
+    }
+
+    // --presence: reads every genome a second time and marks which of the written kmers are in it. fillKeys(keys) writes
+    // the rows kmers sorted by value. false if the matrix couldn't be written
+    template<typename Kmer, typename Fill>
+    bool writePresence(const Settings &settings, const size_t threadCount, FileQueue &queue, const GenomeList &genomes, size_t rows, Fill fillKeys){
+        std::cout << "started the presence matrix\n";
+        PresenceMatrix<Kmer> matrix(settings.presencePath, settings.k, settings.canonical ? COUNTS_FLAG_CANONICAL : 0, genomes.ids.size(), rows);
+        if (!matrix.error.empty()){
+            std::cout << matrix.error << "\n";
+            return false;
+        }
+        fillKeys(matrix.keys);
+        matrix.index();
+        queue.reset();
+        onThreads(threadCount, [&](size_t){
+            PresenceRouter<Kmer> router(matrix);
+            readFiles(settings, queue.largestTask << 1, queue, &router);
+        });
+        endPhase("presence");
+        if (!matrix.finish() || !writeGenomeIndex(settings.presencePath + ".genomes", genomes, settings.phenotypes)){
+            std::cout << "couldn't write " << settings.presencePath << "\n";
+            return false;
+        }
+        std::cout << "presence matrix done(" << rows << " kmers, " << genomes.ids.size() << " genomes)\n";
+        return true;
+    }
+
+    // Same as above for the kmers of sorted runs
+    template<typename Kmer>
+    bool writePresence(const Settings &settings, const size_t threadCount, FileQueue &queue, const GenomeList &genomes, const SortedRuns<Kmer> &runs){
+        size_t rows = std::accumulate(runs.sizes.begin(), runs.sizes.end(), (size_t) 0);
+        return writePresence<Kmer>(settings, threadCount, queue, genomes, rows, [&](Kmer *keys){
+            sortedKeys(runs, threadCount, keys);
+        });
+    }
+
+    // Reads the files of one thread and counts the thread's own shard until every reader is done
+    template<typename Kmer>
+    void countShard(const Settings &settings, const size_t initialBufferSize, FileQueue *queue, ShardedCounter<Kmer> *counter, size_t shard, const KmerFilter *filter, const CountingBloom *bloom){
+        ShardRouter<Kmer> router(*counter, shard, initialBufferSize >> 1);
+        if (bloom){
+            router.prefilter = bloom;
+            router.prefilterMin = std::min<uint32_t>(settings.minPresence, BLOOM_MAX);
+        }
+        readFiles(settings, initialBufferSize, *queue, &router);
+        router.flush();
+        counter->finish(shard);
+        endPhase("count");
+        // filtering and sorting the shards here runs on every thread, writeToFile only merges them
+        KmerTable<Kmer> *table = counter->tables[shard];
+        tableStats("shard " + std::to_string(shard), *table);
+        table->compact();
+        table->count = prepareRun(table->slots, table->count, settings, filter, table->phenotypes);
+    }
+
+    // --max-mem: the kmers go through bin files on disk(diskBins.h) and only threadCount bins are counted at a time.
+    // false if anything couldn't be written, the count functions below return the same
+    template<typename Kmer>
+    bool countOnDisk(const Settings &settings, const int threadCount, FileQueue &queue, const KmerFilter &filter, const GenomeList &genomes){
+        const size_t memory = settings.maxMemory << 20;
+        const size_t fileSize = queue.largestTask;
+        // every nucleotide could start a kmer that's in no other genome, the bins are sized for that
+        const size_t totalBytes = queue.totalSize;
+        size_t binCount = 1;
+        while (binCount < MAX_BINS && totalBytes * sizeof(Slot<Kmer>) * 3 / binCount > memory / threadCount) binCount <<= 1;
+        // a quarter of the memory goes to the blocks the readers collect
+        size_t bufferSize = std::clamp<size_t>(memory / 4 / (threadCount * binCount * 2 * sizeof(Kmer)), MIN_BIN_BUFFER, MAX_BIN_BUFFER);
+        BinFiles bins(settings.tmpFolder, binCount);
+        if (!bins.error.empty()){
+            std::cout << bins.error << "\n";
+            return false;
+        }
+        auto start = std::chrono::high_resolution_clock::now();
+        onThreads(threadCount, [&](size_t){
+            BinRouter<Kmer> router(bins, bufferSize, fileSize);
+            readFiles(settings, fileSize << 1, queue, &router);
+            router.flush();
+        });
+        endPhase("bin");
+        if (stats) stats->value("bins", binCount);
+        auto binned = std::chrono::high_resolution_clock::now();
+        std::cout << "binned the kmers into " << binCount << " bins(" << bins.bytesWritten / MB << " MB in " << bins.folder
+                  << ") in " << std::chrono::duration_cast<std::chrono::milliseconds>(binned - start).count() << " ms\n";
+        std::atomic<size_t> nextBin{0};
+        std::vector<size_t> runSizes(binCount, 0);
+        if (!bins.failed) onThreads(threadCount, [&](size_t){
+            // one table per thread for all of its bins, the bins are about the same size so it's rarely grown after the first
+            KmerTable<Kmer> table(0);
+            for (size_t bin = nextBin++; bin < binCount && !bins.failed; bin = nextBin++) {
+                MappedFile binFile(bins.binPath(bin));
+                table.clear(binFile.size / sizeof(Kmer) / 4);
+                bool complete = readBin<Kmer>(binFile, [&](Kmer data, bool isRes){
+                    table.add(Slot<Kmer>{data, isRes, !isRes, 0, 0});
+                });
+                tableStats("bins", table);
+                table.compact();
+                runSizes[bin] = prepareRun(table.slots, table.count, settings, &filter);
+                std::ofstream run(bins.runPath(bin), std::ios::binary);
+                run.write(reinterpret_cast<const char*>(table.slots), runSizes[bin] * sizeof(Slot<Kmer>));
+                run.close();
+                if ((!complete || !run) && !bins.failed.exchange(true)) std::cout << "couldn't count bin " << bin << " in " << bins.folder << "\n";
+                std::filesystem::remove(bins.binPath(bin));
+            }
+        });
+        if (bins.failed){
+            std::cout << "counting stopped, nothing was written\n";
+            return false;
+        }
+        endPhase("count bins");
+        auto counted = std::chrono::high_resolution_clock::now();
+        std::cout << "counted the bins in " << std::chrono::duration_cast<std::chrono::milliseconds>(counted - binned).count() << " ms\n";
+        // the runs are merged straight from the page cache, they don't have to fit into memory
+        std::vector<MappedFile*> mapped;
+        SortedRuns<Kmer> runs;
+        for (size_t bin = 0; bin < binCount; bin++) {
+            mapped.push_back(new MappedFile(bins.runPath(bin)));
+            runs.slots.push_back(reinterpret_cast<const Slot<Kmer>*>(mapped.back()->data));
+            runs.sizes.push_back(runSizes[bin]);
+        }
+        bool written = writeToFile(runs, threadCount, settings, genomes);
+        if (written && !settings.presencePath.empty()) written = writePresence(settings, threadCount, queue, genomes, runs);
+        for (MappedFile *run : mapped) {
+            delete run;
+        }
+        return written;
+    }
+
+    // --super-kmers: the readers only sort the kmers into minimizer buckets(superKmers.h), then every bucket is counted on
+    // its own with a table small enough to stay in the cache and becomes a sorted run. With --max-mem, or when the buckets
+    // wouldn't fit into the free memory, the buckets spill to bin files and the runs are written to disk like the bins'
+    template<typename Kmer>
+    bool countSuperKmers(const Settings &settings, const int threadCount, FileQueue &queue, const KmerFilter &filter, const GenomeList &genomes){
+        auto start = std::chrono::high_resolution_clock::now();
+        SuperKmerBuckets<Kmer> buckets(settings.k, settings.canonical, threadCount, SuperKmerBuckets<Kmer>::bucketCountFor(queue.largestTask, genomes.ids.size(), threadCount));
+        size_t memory = settings.maxMemory << 20;
+        if (!memory){
+            const size_t estimate = SuperKmerBuckets<Kmer>::estimatedBytes(queue.totalSize, settings.k);
+            const size_t available = availableMemory();
+            if (estimate > available / 2){
+                memory = available / 2;
+                std::cout << "the super-k-mers take about " << estimate / MB << " MB, more than half of the " << available / MB
+                          << " MB of free memory, they spill to " << settings.tmpFolder << "\n";
+            }
+        }
+        BinFiles *bins = nullptr;
+        if (memory){
+            bins = new BinFiles(settings.tmpFolder, buckets.bucketCount);
+            if (!bins->error.empty()){
+                std::cout << bins->error << "\n";
+                delete bins;
+                return false;
+            }
+            // half of the memory goes to the streams, the rest to the tables and the runs that are being written
+            buckets.spillTo(*bins, memory / 2);
+        }
+        onThreads(threadCount, [&](size_t reader){
+            SuperKmerRouter<Kmer> router(buckets, reader);
+            readFiles(settings, queue.largestTask << 1, queue, &router);
+        });
+        endPhase("bucket");
+        auto bucketed = std::chrono::high_resolution_clock::now();
+        std::cout << "grouped " << buckets.kmers << " kmers into " << buckets.superKmers << " super-k-mers("
+                  << (buckets.superKmers ? (double) buckets.kmers / buckets.superKmers : 0) << " kmers each, " << buckets.bytes() / MB << " MB in "
+                  << buckets.bucketCount << " buckets";
+        if (bins) std::cout << ", " << bins->bytesWritten / MB << " MB of them in " << bins->folder;
+        std::cout << ") in " << std::chrono::duration_cast<std::chrono::milliseconds>(bucketed - start).count() << " ms\n";
+        if (stats){
+            stats->value("buckets", buckets.bucketCount);
+            stats->value("super_kmers", buckets.superKmers);
+            stats->value("bucket_mb", buckets.bytes() / MB);
+            if (bins) stats->value("spilled_mb", bins->bytesWritten / MB);
+        }
+        std::vector<std::vector<Slot<Kmer>>> counted(bins ? 0 : buckets.bucketCount);
+        std::vector<size_t> runSizes(buckets.bucketCount, 0);
+        bool complete = !(bins && bins->failed) && countBuckets(buckets, threadCount, [&](size_t bucket, KmerTable<Kmer> &table){
+            tableStats("buckets", table);
+            table.compact();
+            runSizes[bucket] = prepareRun(table.slots, table.count, settings, &filter);
+            if (!bins){
+                counted[bucket].assign(table.slots, table.slots + runSizes[bucket]);
+                return;
+            }
+            std::ofstream run(bins->runPath(bucket), std::ios::binary);
+            run.write(reinterpret_cast<const char*>(table.slots), runSizes[bucket] * sizeof(Slot<Kmer>));
+            run.close();
+            if (!run && !bins->failed.exchange(true)) std::cout << "couldn't write " << bins->runPath(bucket) << "\n";
+        });
+        if (!complete || (bins && bins->failed)){
+            std::cout << "counting stopped, nothing was written\n";
+            delete bins;
+            return false;
+        }
+        endPhase("count buckets");
+        auto done = std::chrono::high_resolution_clock::now();
+        std::cout << "counted the buckets in " << std::chrono::duration_cast<std::chrono::milliseconds>(done - bucketed).count() << " ms\n";
+        std::vector<MappedFile*> mapped;
+        SortedRuns<Kmer> runs;
+        for (size_t bucket = 0; bucket < buckets.bucketCount; bucket++) {
+            if (bins){
+                mapped.push_back(new MappedFile(bins->runPath(bucket)));
+                runs.slots.push_back(reinterpret_cast<const Slot<Kmer>*>(mapped.back()->data));
+            }
+            else runs.slots.push_back(counted[bucket].data());
+            runs.sizes.push_back(runSizes[bucket]);
+        }
+        bool written = writeToFile(runs, threadCount, settings, genomes);
+        if (written && !settings.presencePath.empty()) written = writePresence(settings, threadCount, queue, genomes, runs);
+        for (MappedFile *run : mapped) {
+            delete run;
+        }
+        delete bins;
+        return written;
+    }
+
+    // The hash table path, Kmer is size_t up to k = 32 and unsigned __int128 above that
+    template<typename Kmer>
+    bool countSharded(const Settings &settings, const int threadCount, FileQueue &queue, const KmerFilter &filter, const GenomeList &genomes){
+        if (settings.superKmers) return countSuperKmers<Kmer>(settings, threadCount, queue, filter, genomes);
+        if (settings.maxMemory) return countOnDisk<Kmer>(settings, threadCount, queue, filter, genomes);
+        const size_t fileSize = queue.largestTask;
+        CountingBloom *bloom = nullptr;
+        if (settings.twoPass){
+            auto start = std::chrono::high_resolution_clock::now();
+            bloom = new CountingBloom(settings.bloomMemory << 20);
+            onThreads(threadCount, [&](size_t){
+                BloomRouter<Kmer> router(*bloom, fileSize);
+                readFiles(settings, fileSize << 1, queue, &router);
+            });
+            queue.reset();
+            endPhase("first pass");
+            auto stop = std::chrono::high_resolution_clock::now();
+            std::cout << "first pass done in " << std::chrono::duration_cast<std::chrono::milliseconds>(stop - start).count()
+                      << " ms(" << bloom->size() / MB << " MB counting bloom filter)\n";
+        }
+        auto *counter = new ShardedCounter<Kmer>(threadCount, fileSize); // kmer tables split between the threads by hash
+        if (settings.phenotypes){
+            for (int i = 0; i < threadCount; i++) {
+                counter->tables[i]->phenotypes = new PhenotypeCounters(*settings.phenotypes);
+            }
+        }
+        auto *threads = new std::thread[threadCount];
+        for (int i = 0; i < threadCount; i++) {
+            threads[i] = std::thread([&, i]{ countShard<Kmer>(settings, fileSize << 1, &queue, counter, i, &filter, bloom); });
+        }
+        for (int i = 0; i < threadCount; i++)
+            threads[i].join();
+        endPhase("sort");
+        delete bloom;
+        SortedRuns<Kmer> runs;
+        for (int i = 0; i < threadCount; i++) {
+            runs.slots.push_back(counter->tables[i]->slots);
+            runs.sizes.push_back(counter->tables[i]->count);
+            runs.phenotypes.push_back(counter->tables[i]->phenotypes);
+        }
+        bool written = writeToFile(runs, threadCount, settings, genomes);
+        if (written && !settings.presencePath.empty()) written = writePresence(settings, threadCount, queue, genomes, runs);
+        delete[] threads;
+        delete counter;
+        return written;
+    }
+};
+
+inline CountStatus countGenomes(const Settings &settings){
+    GenomeCounter counter;
+    return counter.count(settings);
+}
+
+#endif
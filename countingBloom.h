@@ -0,0 +1,89 @@
+/**
+ * First pass of --two-pass. Every genome is read once to count in how many genomes each kmer is, roughly, in a counting
+ * Bloom filter. The real counting pass then leaves out kmers the filter has seen in fewer than --min-presence genomes,
+ * so the ones that are only in one or two genomes never take up a slot in the tables.
+ *
+ * The filter never counts too low, so no kmer that passes --min-presence gets lost. It can count too high for kmers
+ * that share counters with others, those get counted and are dropped by the real filter at the end. Counters are
+ * 8 bits and stop at 255. The 3 counters of a kmer sit in the same 64 byte line, so a kmer costs one cache miss.
+ */
+
+#ifndef COUNTINGBLOOM_H
+#define COUNTINGBLOOM_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+#include "kmerTable.h"
+#include "slabMemory.h"
+
+#define DEFAULT_BLOOM_MEMORY 1024 // MB
+#define BLOOM_LINE 64
+#define BLOOM_HASHES 3
+#define BLOOM_MAX 255
+
+class CountingBloom{
+public:
+    // bytes is rounded down to a power of two lines
+    explicit CountingBloom(size_t bytes){
+        lines = 1;
+        while (lines * 2 * BLOOM_LINE <= bytes) lines <<= 1;
+        counters = static_cast<uint8_t*>(allocateZeroed(lines * BLOOM_LINE));
+    }
+    ~CountingBloom(){
+        releaseZeroed(counters, lines * BLOOM_LINE);
+    }
+    CountingBloom(const CountingBloom&) = delete;
+    CountingBloom &operator=(const CountingBloom&) = delete;
+
+    size_t size() const{
+        return lines * BLOOM_LINE;
+    }
+
+    // hash is the mixHash of the kmer, several threads add at once
+    void add(size_t hash){
+        uint8_t *line = lineOf(hash);
+        for (int i = 0; i < BLOOM_HASHES; i++) {
+            uint8_t *counter = line + ((hash >> (6 * i)) & (BLOOM_LINE - 1));
+            uint8_t value = __atomic_load_n(counter, __ATOMIC_RELAXED);
+            while (value < BLOOM_MAX && !__atomic_compare_exchange_n(counter, &value, value + 1, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)){}
+        }
+    }
+
+    // At least as many genomes as the kmer is in, up to 255
+    uint32_t count(size_t hash) const{
+        const uint8_t *line = lineOf(hash);
+        uint32_t lowest = BLOOM_MAX;
+        for (int i = 0; i < BLOOM_HASHES; i++) {
+            lowest = std::min<uint32_t>(lowest, __atomic_load_n(line + ((hash >> (6 * i)) & (BLOOM_LINE - 1)), __ATOMIC_RELAXED));
+        }
+        return lowest;
+    }
+
+private:
+    uint8_t *counters;
+    size_t lines;
+
+    // the line comes from the high bits, the counters in it from the low ones
+    uint8_t *lineOf(size_t hash) const{
+        return counters + static_cast<size_t>((static_cast<unsigned __int128>(hash) * lines) >> 64) * BLOOM_LINE;
+    }
+};
+
+// Stands in for the ShardRouter in the first pass, every kmer is added once per genome
+template<typename K>
+class BloomRouter{
+public:
+    typedef K Kmer;
+    CountingBloom &bloom;
+    FileKmerSet<Kmer> seen;
+
+    BloomRouter(CountingBloom &bloom, size_t expectedKmers): bloom(bloom), seen(expectedKmers){}
+
+    void push(Kmer data, uint32_t fileNr, bool){
+        if (seen.insert(data, fileNr)) bloom.add(mixHash(data));
+    }
+};
+
+#endif
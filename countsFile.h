@@ -0,0 +1,382 @@
+/**
+ * Binary counts file(counts.kmc, --binary). Kmers are written sorted by value, so every kmer is stored as the
+ * difference to the one before it in a varint, most of them take 2-4 bytes instead of up to 20 digits. res and sus
+ * are packed into as many bits as the biggest value in the block needs. Blocks are collected in a big buffer and
+ * written out in one go. `./kmerCounter convert counts.kmc` turns the file back into text.
+ *
+ * A counts file that wasn't filtered is also a database: it lists the genomes it was counted from, so new genomes can
+ * be counted on their own and merged in(database.h).
+ *
+ * Layout(little endian):
+ *   header: "KMRC", uint32 version, uint32 k, uint32 flags(1 = canonical, 2 = filtered), uint32 res files,
+ *           uint32 sus files, uint64 kmer count
+ *   genomes(since version 2): uint32 genomes, then for every genome uint8 resistant, uint16 id length and the id
+ *   blocks of up to COUNTS_BLOCK kmers: uint32 kmers, uint32 key bytes, uint8 res bits, uint8 sus bits,
+ *           the keys(LEB128, the first key of a block is stored whole so a block can be read on its own),
+ *           the res column and the sus column, each padded to a whole byte
+ */
+
+#ifndef COUNTSFILE_H
+#define COUNTSFILE_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "kmer.h"
+#include "mappedFile.h"
+
+#define COUNTS_MAGIC "KMRC"
+#define COUNTS_VERSION 2
+#define COUNTS_BLOCK 65536 // kmers per block
+#define COUNTS_BUFFER (16 << 20) // bytes collected before they're written, has to fit a whole block
+#define COUNTS_FLAG_CANONICAL 1
+#define COUNTS_FLAG_FILTERED 2 // some kmers were left out(--min-presence and such), it can't be added to
+
+struct CountsHeader{
+    char magic[4];
+    uint32_t version;
+    uint32_t k;
+    uint32_t flags;
+    uint32_t resAmount;
+    uint32_t susAmount;
+    uint64_t kmerCount;
+};
+
+#define COUNTS_HEADER_SIZE 32
+#define COUNTS_BLOCK_HEADER_SIZE 10
+
+// The genomes that were counted, by their id in meta.csv
+struct GenomeList{
+    std::vector<std::string> ids;
+    std::vector<bool> resistant;
+    uint32_t resAmount{};
+    uint32_t susAmount{};
+
+    void add(const std::string &id, bool isRes){
+        ids.push_back(id);
+        resistant.push_back(isRes);
+        if (isRes) resAmount++;
+        else susAmount++;
+    }
+};
+
+// Bits needed for the biggest value of a column, a column of zeros takes no space at all
+inline unsigned bitsFor(uint32_t max){
+    return max ? 32 - __builtin_clz(max) : 0;
+}
+
+inline size_t packColumn(const uint32_t *values, size_t count, unsigned bits, uint8_t *to){
+    uint64_t pending = 0;
+    unsigned filled = 0;
+    size_t n = 0;
+    for (size_t i = 0; i < count; i++) {
+        pending |= (uint64_t) values[i] << filled;
+        filled += bits;
+        while (filled >= 8){
+            to[n++] = static_cast<uint8_t>(pending);
+            pending >>= 8;
+            filled -= 8;
+        }
+    }
+    if (filled) to[n++] = static_cast<uint8_t>(pending);
+    return n;
+}
+
+inline const uint8_t *unpackColumn(const uint8_t *from, size_t count, unsigned bits, uint32_t *values){
+    const uint64_t mask = ((uint64_t) 1 << bits) - 1;
+    uint64_t pending = 0;
+    unsigned filled = 0;
+    for (size_t i = 0; i < count; i++) {
+        while (filled < bits){
+            pending |= (uint64_t) *from++ << filled;
+            filled += 8;
+        }
+        values[i] = static_cast<uint32_t>(pending & mask);
+        pending >>= bits;
+        filled -= bits;
+    }
+    return from;
+}
+
+template<typename Kmer>
+inline size_t putVarint(Kmer value, uint8_t *to){
+    size_t n = 0;
+    while (value >= 0x80){
+        to[n++] = static_cast<uint8_t>(value) | 0x80;
+        value >>= 7;
+    }
+    to[n++] = static_cast<uint8_t>(value);
+    return n;
+}
+
+// Returns nullptr if the varint runs past end
+template<typename Kmer>
+inline const uint8_t *getVarint(const uint8_t *from, const uint8_t *end, Kmer &value){
+    value = 0;
+    for (unsigned shift = 0; from < end && shift < sizeof(Kmer) * 8; shift += 7) {
+        uint8_t byte = *from++;
+        value |= (Kmer) (byte & 0x7F) << shift;
+        if (!(byte & 0x80)) return from;
+    }
+    return nullptr;
+}
+
+// Kmers have to be added in increasing order
+template<typename Kmer>
+class CountsWriter{
+public:
+    CountsWriter(const std::string &path, size_t k, uint32_t flags, const GenomeList &genomes){
+        out.open(path, std::ios::binary);
+        header = {{'K', 'M', 'R', 'C'}, COUNTS_VERSION, static_cast<uint32_t>(k), flags, genomes.resAmount, genomes.susAmount, 0};
+        out.write(reinterpret_cast<const char*>(&header), COUNTS_HEADER_SIZE);
+        auto genomeCount = static_cast<uint32_t>(genomes.ids.size());
+        out.write(reinterpret_cast<const char*>(&genomeCount), 4);
+        for (size_t i = 0; i < genomes.ids.size(); i++) {
+            uint8_t resistant = genomes.resistant[i];
+            auto length = static_cast<uint16_t>(genomes.ids[i].size());
+            out.write(reinterpret_cast<const char*>(&resistant), 1);
+            out.write(reinterpret_cast<const char*>(&length), 2);
+            out.write(genomes.ids[i].data(), length);
+        }
+        buffer = new uint8_t[COUNTS_BUFFER];
+        res = new uint32_t[COUNTS_BLOCK];
+        sus = new uint32_t[COUNTS_BLOCK];
+    }
+    ~CountsWriter(){
+        delete[] buffer;
+        delete[] res;
+        delete[] sus;
+    }
+    CountsWriter(const CountsWriter&) = delete;
+    CountsWriter &operator=(const CountsWriter&) = delete;
+
+    void add(Kmer data, uint32_t resOccurences, uint32_t susOccurences){
+        if (blockSize == 0){
+            // room for the block header, the keys and both columns at their widest
+            if (used + COUNTS_BLOCK_HEADER_SIZE + COUNTS_BLOCK * (VARINT_MAX + 8) > COUNTS_BUFFER) flushBuffer();
+            blockStart = used;
+            used += COUNTS_BLOCK_HEADER_SIZE;
+            previous = 0;
+        }
+        used += putVarint(data - previous, buffer + used);
+        previous = data;
+        res[blockSize] = resOccurences;
+        sus[blockSize] = susOccurences;
+        if (++blockSize == COUNTS_BLOCK) finishBlock();
+    }
+
+    // Writes what's left and fills in the kmer count, false if the file couldn't be written
+    bool close(){
+        if (blockSize) finishBlock();
+        flushBuffer();
+        out.seekp(0);
+        out.write(reinterpret_cast<const char*>(&header), COUNTS_HEADER_SIZE);
+        out.close();
+        return !out.fail();
+    }
+
+private:
+    static const size_t VARINT_MAX = (sizeof(Kmer) * 8 + 6) / 7;
+    std::ofstream out;
+    CountsHeader header{};
+    uint8_t *buffer;
+    size_t used{};
+    uint32_t *res;
+    uint32_t *sus;
+    size_t blockSize{};
+    size_t blockStart{};
+    Kmer previous{};
+
+    void finishBlock(){
+        uint32_t maxRes = 0, maxSus = 0;
+        for (size_t i = 0; i < blockSize; i++) {
+            maxRes = std::max(maxRes, res[i]);
+            maxSus = std::max(maxSus, sus[i]);
+        }
+        auto kmers = static_cast<uint32_t>(blockSize);
+        auto keyBytes = static_cast<uint32_t>(used - blockStart - COUNTS_BLOCK_HEADER_SIZE);
+        uint8_t resBits = bitsFor(maxRes), susBits = bitsFor(maxSus);
+        std::memcpy(buffer + blockStart, &kmers, 4);
+        std::memcpy(buffer + blockStart + 4, &keyBytes, 4);
+        buffer[blockStart + 8] = resBits;
+        buffer[blockStart + 9] = susBits;
+        used += packColumn(res, blockSize, resBits, buffer + used);
+        used += packColumn(sus, blockSize, susBits, buffer + used);
+        header.kmerCount += blockSize;
+        blockSize = 0;
+    }
+
+    void flushBuffer(){
+        out.write(reinterpret_cast<const char*>(buffer), used);
+        used = 0;
+    }
+};
+
+// A counts file mapped into memory, with its header and genomes read
+class CountsFile{
+public:
+    MappedFile file;
+    CountsHeader header{};
+    GenomeList genomes;
+    const uint8_t *blocks{}; // where the kmers start
+    const uint8_t *end{};
+    std::string error; // empty if the file could be opened and looks like a counts file
+
+    explicit CountsFile(const std::string &path): file(path){
+        if (!file.opened || file.size < COUNTS_HEADER_SIZE){
+            error = "couldn't open " + path;
+            return;
+        }
+        std::memcpy(&header, file.data, COUNTS_HEADER_SIZE);
+        if (std::memcmp(header.magic, COUNTS_MAGIC, 4) != 0 || header.version < 1 || header.version > COUNTS_VERSION
+            || header.k < 1 || header.k > MAX_K){
+            error = path + " isn't a counts file";
+            return;
+        }
+        blocks = reinterpret_cast<const uint8_t*>(file.data) + COUNTS_HEADER_SIZE;
+        end = reinterpret_cast<const uint8_t*>(file.data) + file.size;
+        if (header.version >= 2 && !readGenomes()) error = path + " is truncated or broken";
+    }
+
+    bool canonical() const{
+        return header.flags & COUNTS_FLAG_CANONICAL;
+    }
+
+private:
+    bool readGenomes(){
+        uint32_t genomeCount;
+        if (end - blocks < 4) return false;
+        std::memcpy(&genomeCount, blocks, 4);
+        blocks += 4;
+        for (uint32_t i = 0; i < genomeCount; i++) {
+            uint16_t length;
+            if (end - blocks < 3) return false;
+            bool resistant = blocks[0];
+            std::memcpy(&length, blocks + 1, 2);
+            blocks += 3;
+            if (end - blocks < length) return false;
+            genomes.add(std::string(reinterpret_cast<const char*>(blocks), length), resistant);
+            blocks += length;
+        }
+        return true;
+    }
+};
+
+// Reads a counts file block by block straight from the mapping
+template<typename Kmer>
+class CountsReader{
+public:
+    Kmer keys[COUNTS_BLOCK];
+    uint32_t res[COUNTS_BLOCK];
+    uint32_t sus[COUNTS_BLOCK];
+    size_t blockSize{};
+    bool broken{}; // a block ran past the end of the file
+
+    explicit CountsReader(const CountsFile &counts): at(counts.blocks), end(counts.end){}
+
+    // Decodes the next block into keys/res/sus, false at the end of the file or if the file is broken
+    bool next(){
+        blockSize = 0;
+        if (at == end) return false;
+        uint32_t kmers, keyBytes;
+        if (end - at < COUNTS_BLOCK_HEADER_SIZE) return fail();
+        std::memcpy(&kmers, at, 4);
+        std::memcpy(&keyBytes, at + 4, 4);
+        unsigned resBits = at[8], susBits = at[9];
+        at += COUNTS_BLOCK_HEADER_SIZE;
+        size_t columnBytes = (kmers * resBits + 7) / 8 + (kmers * susBits + 7) / 8;
+        if (kmers > COUNTS_BLOCK || resBits > 32 || susBits > 32 || (size_t) (end - at) < keyBytes + columnBytes) return fail();
+        const uint8_t *keysEnd = at + keyBytes;
+        Kmer previous = 0;
+        for (uint32_t i = 0; i < kmers; i++) {
+            Kmer delta;
+            at = getVarint(at, keysEnd, delta);
+            if (!at) return fail();
+            previous += delta;
+            keys[i] = previous;
+        }
+        at = unpackColumn(keysEnd, kmers, resBits, res);
+        at = unpackColumn(at, kmers, susBits, sus);
+        blockSize = kmers;
+        return true;
+    }
+
+private:
+    const uint8_t *at;
+    const uint8_t *end;
+
+    bool fail(){
+        broken = true;
+        at = end;
+        return false;
+    }
+};
+
+// Writes the kmer as nucleotides, the first nucleotide is in the highest bits
+template<typename Kmer>
+inline char *writeNucleotides(Kmer kmer, size_t k, char *to){
+    for (size_t i = 0; i < k; i++) {
+        to[i] = "ACGT"[static_cast<unsigned>(kmer >> (2 * (k - 1 - i))) & 3];
+    }
+    return to + k;
+}
+
+template<typename Kmer>
+bool exportCounts(const CountsFile &counts, std::ofstream &out, char separator){
+    const CountsHeader &header = counts.header;
+    auto *reader = new CountsReader<Kmer>(counts);
+    const size_t lineMax = header.k + 2 * 11 + 1;
+    auto *text = new char[COUNTS_BUFFER];
+    char *at = text;
+    at += std::sprintf(at, "kmer%cres%csus\n", separator, separator);
+    uint64_t written = 0;
+    while (reader->next()){
+        for (size_t i = 0; i < reader->blockSize; i++) {
+            if (at + lineMax > text + COUNTS_BUFFER){
+                out.write(text, at - text);
+                at = text;
+            }
+            at = writeNucleotides(reader->keys[i], header.k, at);
+            *at++ = separator;
+            at = writeNumber(reader->res[i], at);
+            *at++ = separator;
+            at = writeNumber(reader->sus[i], at);
+            *at++ = '\n';
+        }
+        written += reader->blockSize;
+    }
+    out.write(text, at - text);
+    bool ok = !reader->broken && written == header.kmerCount;
+    delete[] text;
+    delete reader;
+    return ok;
+}
+
+// counts.kmc -> csv(or tsv) with one row per kmer in the order of the file(by kmer value)
+inline bool convertCounts(const std::string &path, const std::string &outPath, char separator){
+    CountsFile counts(path);
+    if (!counts.error.empty()){
+        std::cout << counts.error << "\n";
+        return false;
+    }
+    const CountsHeader &header = counts.header;
+    std::ofstream out(outPath, std::ios::binary);
+    if (!out){
+        std::cout << "couldn't open " << outPath << "\n";
+        return false;
+    }
+    std::cout << header.k << "-mers" << (header.flags & COUNTS_FLAG_CANONICAL ? "(canonical)" : "") << " from "
+              << header.resAmount << " resistant and " << header.susAmount << " susceptible genomes, "
+              << header.kmerCount << " kmers\n";
+    bool ok = wordsFor(header.k) == 1 ? exportCounts<KmerWord<1>::type>(counts, out, separator)
+                                      : exportCounts<KmerWord<2>::type>(counts, out, separator);
+    if (!ok) std::cout << path << " is truncated or broken\n";
+    return ok;
+}
+
+#endif
@@ -0,0 +1,156 @@
+/**
+ * Counts files as a database that grows. A counts file that wasn't filtered has the res and sus count of every kmer and
+ * the list of genomes it was counted from, so two of them over different genomes can be merged into the counts of all
+ * genomes together without reading a fasta file again. Both files are sorted by kmer, the merge walks them side by side
+ * and adds up the counts of kmers that are in both.
+ *
+ * `./kmerCounter add db.kmc folder ...` counts only the genomes of the folder that aren't in db.kmc yet and merges them
+ * in, `./kmerCounter merge a.kmc b.kmc out.kmc` merges two files that were counted on their own.
+ */
+
+#ifndef DATABASE_H
+#define DATABASE_H
+
+#include <filesystem>
+#include <iostream>
+#include <string>
+#include <unordered_set>
+#include "countsFile.h"
+
+// One counts file being walked kmer by kmer
+template<typename Kmer>
+class CountsCursor{
+public:
+    explicit CountsCursor(const CountsFile &counts){
+        reader = new CountsReader<Kmer>(counts);
+        done = !reader->next();
+    }
+    ~CountsCursor(){
+        delete reader;
+    }
+    CountsCursor(const CountsCursor&) = delete;
+    CountsCursor &operator=(const CountsCursor&) = delete;
+
+    bool done;
+
+    Kmer kmer() const{ return reader->keys[at]; }
+    uint32_t res() const{ return reader->res[at]; }
+    uint32_t sus() const{ return reader->sus[at]; }
+    bool broken() const{ return reader->broken; }
+
+    void advance(){
+        if (++at < reader->blockSize) return;
+        at = 0;
+        done = !reader->next();
+    }
+
+private:
+    CountsReader<Kmer> *reader;
+    size_t at{};
+};
+
+// Why counts with these headers can't be merged, empty if they can
+inline std::string mergeProblem(const CountsHeader &a, const CountsHeader &b){
+    if (a.k != b.k) return "the k values are different(" + std::to_string(a.k) + " and " + std::to_string(b.k) + ")";
+    if ((a.flags ^ b.flags) & COUNTS_FLAG_CANONICAL) return "only one of them counts canonical kmers";
+    if ((a.flags | b.flags) & COUNTS_FLAG_FILTERED) return "filtered counts can't be merged, they're missing kmers";
+    if (a.version < 2 || b.version < 2) return "one of them was written before counts files listed their genomes, count it again";
+    return "";
+}
+
+inline std::string mergeProblem(const CountsFile &a, const CountsFile &b){
+    std::string problem = mergeProblem(a.header, b.header);
+    if (!problem.empty()) return problem;
+    std::unordered_set<std::string> ids(a.genomes.ids.begin(), a.genomes.ids.end());
+    size_t duplicates = 0;
+    std::string example;
+    for (const std::string &id: b.genomes.ids) {
+        if (ids.count(id) && !duplicates++) example = id;
+    }
+    if (duplicates) return std::to_string(duplicates) + " genomes are in both files(" + example + " for one), they'd be counted twice";
+    return "";
+}
+
+template<typename Kmer>
+bool mergeCounts(const CountsFile &a, const CountsFile &b, const std::string &outPath){
+    GenomeList genomes = a.genomes;
+    for (size_t i = 0; i < b.genomes.ids.size(); i++) {
+        genomes.add(b.genomes.ids[i], b.genomes.resistant[i]);
+    }
+    CountsWriter<Kmer> writer(outPath, a.header.k, a.header.flags, genomes);
+    CountsCursor<Kmer> first(a), second(b);
+    while (!first.done || !second.done){
+        if (second.done || (!first.done && first.kmer() < second.kmer())){
+            writer.add(first.kmer(), first.res(), first.sus());
+            first.advance();
+        }
+        else if (first.done || second.kmer() < first.kmer()){
+            writer.add(second.kmer(), second.res(), second.sus());
+            second.advance();
+        }
+        else{
+            writer.add(first.kmer(), first.res() + second.res(), first.sus() + second.sus());
+            first.advance();
+            second.advance();
+        }
+    }
+    bool written = writer.close();
+    if (first.broken() || second.broken()){
+        std::cout << "one of the files is truncated or broken\n";
+        return false;
+    }
+    if (!written) std::cout << "couldn't write " << outPath << "\n";
+    return written;
+}
+
+inline bool sameFile(const std::string &first, const std::string &second){
+    std::error_code error;
+    return std::filesystem::equivalent(first, second, error) && !error;
+}
+
+// Merges a and b into outPath, false with a message if they don't go together. The merge is written next to outPath
+// and only moved over it once it's complete, so outPath can be one of the inputs: they're mapped while it's written
+inline bool mergeDatabases(const std::string &pathA, const std::string &pathB, const std::string &outPath){
+    CountsFile a(pathA), b(pathB);
+    for (const CountsFile *counts: {&a, &b}) {
+        if (!counts->error.empty()){
+            std::cout << counts->error << "\n";
+            return false;
+        }
+    }
+    std::string problem = mergeProblem(a, b);
+    if (!problem.empty()){
+        std::cout << "can't merge " << pathA << " and " << pathB << ": " << problem << "\n";
+        return false;
+    }
+    std::cout << "merging " << a.genomes.ids.size() << " and " << b.genomes.ids.size() << " genomes\n";
+    std::string mergedPath = outPath + ".tmp";
+    while (sameFile(mergedPath, pathA) || sameFile(mergedPath, pathB)) mergedPath += ".tmp";
+    bool merged = wordsFor(a.header.k) == 1 ? mergeCounts<KmerWord<1>::type>(a, b, mergedPath)
+                                            : mergeCounts<KmerWord<2>::type>(a, b, mergedPath);
+    std::error_code error;
+    if (merged){
+        std::filesystem::rename(mergedPath, outPath, error);
+        if (error) std::cout << "couldn't move " << mergedPath << " to " << outPath << ": " << error.message() << "\n";
+    }
+    std::error_code removeError;
+    if (!merged || error) std::filesystem::remove(mergedPath, removeError);
+    return merged && !error;
+}
+
+// Merges the newly counted genomes into the database, or makes them the database if there isn't one yet
+inline bool addToDatabase(const std::string &databasePath, const std::string &newPath){
+    std::error_code error;
+    if (!std::filesystem::exists(databasePath)){
+        std::filesystem::rename(newPath, databasePath, error);
+        if (error) std::cout << "couldn't move " << newPath << " to " << databasePath << ": " << error.message() << "\n";
+        return !error;
+    }
+    // the database is only replaced once the merge went through
+    bool merged = mergeDatabases(databasePath, newPath, databasePath);
+    if (merged) std::filesystem::remove(newPath, error);
+    else std::cout << "the new genomes are kept in " << newPath << "\n";
+    return merged;
+}
+
+#endif
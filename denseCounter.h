@@ -0,0 +1,63 @@
+/**
+ * Counter for small k where every possible kmer gets its own slot, the kmer itself is the index.
+ * There's no hashing, probing or growing, the whole 4^k array is allocated up front so it's only used when
+ * 4^k * sizeof(DenseSlot) per thread fits into the memory budget(see --dense-mem).
+ */
+
+#ifndef DENSECOUNTER_H
+#define DENSECOUNTER_H
+
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+#include "slabMemory.h"
+
+#define DEFAULT_DENSE_MEMORY 1024 // MB that the dense counters of all threads may use together
+
+struct DenseSlot{
+    uint32_t resOccurences;
+    uint32_t susOccurences;
+    uint32_t fileNr; // last file that counted this kmer, file numbers start at 1 so 0 means never seen
+};
+
+class DenseCounter{
+public:
+    typedef size_t Kmer; // only ever used for small k
+    DenseSlot *slots{};
+    size_t size{};
+
+    explicit DenseCounter(size_t kmerCount){
+        size = kmerCount;
+        // the pages are only backed by memory once they get written to
+        slots = static_cast<DenseSlot*>(allocateZeroed(size * sizeof(DenseSlot)));
+    }
+    ~DenseCounter(){
+        releaseZeroed(slots, size * sizeof(DenseSlot));
+    }
+    DenseCounter(const DenseCounter&) = delete;
+    DenseCounter &operator=(const DenseCounter&) = delete;
+
+    void push(size_t data, uint32_t fileNr, bool isRes){
+        DenseSlot &slot = slots[data];
+        if (slot.fileNr != fileNr){
+            if (isRes) slot.resOccurences++;
+            else slot.susOccurences++;
+            slot.fileNr = fileNr;
+        }
+    }
+
+    // Adds the counts of other for the kmers in [begin, end)
+    void add(const DenseCounter &other, size_t begin, size_t end){
+        for (size_t i = begin; i < end; i++) {
+            slots[i].resOccurences += other.slots[i].resOccurences;
+            slots[i].susOccurences += other.slots[i].susOccurences;
+        }
+    }
+};
+
+// Whether 4^k slots for every thread fit into the budget
+inline bool fitsDenseBudget(size_t kmerCount, size_t threadCount, size_t budgetMB){
+    return kmerCount <= (budgetMB << 20) / sizeof(DenseSlot) / threadCount;
+}
+
+#endif
@@ -0,0 +1,222 @@
+/**
+ * External memory counting(--max-mem). Instead of one table for everything, the readers drop each kmer into one of
+ * binCount bin files in a temporary folder, picked by the kmer's hash, once per genome. The bins are then counted one
+ * at a time per thread, every bin only needs a table for its own share of the kmers, and each counted bin is written
+ * back as a sorted run that the writer merges like the shard tables.
+ *
+ * A bin file is a list of blocks: uint32 res kmers, uint32 sus kmers, then the res kmers and the sus kmers. Readers
+ * collect a block per bin and append it to the file under the bin's lock, the file is opened for every block so the
+ * number of bins isn't limited by how many files can be open at once.
+ *
+ * The super-k-mer buckets(superKmers.h) spill into bin files of their own kind: chunks of uint32 writer, uint32 bytes
+ * and the bytes.
+ *
+ * Every run gets a folder of its own inside --tmp-dir(kmerCounter.XXXXXX), so the bins always start out empty, and
+ * only that folder is removed again. Whatever else is in --tmp-dir, or another run that shares it, isn't touched.
+ */
+
+#ifndef DISKBINS_H
+#define DISKBINS_H
+
+#include <atomic>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <initializer_list>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <fcntl.h>
+#include <unistd.h>
+#include "kmerTable.h"
+#include "mappedFile.h"
+
+#define MAX_BINS 1024
+#define MIN_BIN_BUFFER 256 // res and sus kmers per bin a reader collects before it writes them out
+#define MAX_BIN_BUFFER 4096
+
+// Picked the same way as the shards, from the high bits of the hash
+template<typename Kmer>
+inline size_t binOf(Kmer data, size_t binCount){
+    return static_cast<size_t>((static_cast<unsigned __int128>(mixHash(data)) * binCount) >> 64);
+}
+
+class BinFiles{
+public:
+    std::string folder; // the run's own folder inside tmpFolder
+    const size_t binCount;
+    std::string error; // empty if the folder could be created
+    std::atomic<size_t> bytesWritten{0};
+    std::atomic<bool> failed{false}; // a write went wrong(disk full), the counts can't be trusted
+
+    BinFiles(const std::string &tmpFolder, size_t binCount): binCount(binCount), tmpFolder(tmpFolder){
+        locks = new std::mutex[binCount];
+        std::error_code created;
+        createdTmpFolder = std::filesystem::create_directories(tmpFolder, created);
+        std::string name = tmpFolder + "/kmerCounter.XXXXXX";
+        if (created || !mkdtemp(name.data())){
+            error = "couldn't create a folder in " + tmpFolder + ": " + (created ? created.message() : std::strerror(errno));
+            return;
+        }
+        folder = name;
+    }
+    // The files are gone with the folder, anything that maps them has to be closed before
+    ~BinFiles(){
+        delete[] locks;
+        std::error_code ignored;
+        if (!folder.empty()) std::filesystem::remove_all(folder, ignored);
+        // only removed if it's empty and wasn't there before
+        if (createdTmpFolder) std::filesystem::remove(tmpFolder, ignored);
+    }
+    BinFiles(const BinFiles&) = delete;
+    BinFiles &operator=(const BinFiles&) = delete;
+
+    std::string binPath(size_t bin) const{
+        return folder + "/bin" + std::to_string(bin);
+    }
+
+    std::string runPath(size_t bin) const{
+        return folder + "/run" + std::to_string(bin);
+    }
+
+    template<typename Kmer>
+    void append(size_t bin, const Kmer *res, uint32_t resCount, const Kmer *sus, uint32_t susCount){
+        uint32_t counts[2] = {resCount, susCount};
+        appendParts(bin, {{counts, sizeof(counts)}, {res, resCount * sizeof(Kmer)}, {sus, susCount * sizeof(Kmer)}});
+    }
+
+    void appendChunk(size_t bin, uint32_t writer, const uint8_t *data, size_t size){
+        uint32_t header[2] = {writer, static_cast<uint32_t>(size)};
+        appendParts(bin, {{header, sizeof(header)}, {data, size}});
+    }
+
+private:
+    std::mutex *locks;
+    const std::string tmpFolder;
+    bool createdTmpFolder = false;
+
+    void appendParts(size_t bin, std::initializer_list<std::pair<const void*, size_t>> parts){
+        std::lock_guard<std::mutex> lock(locks[bin]);
+        int fd = open(binPath(bin).c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+        bool written = fd >= 0;
+        size_t bytes = 0;
+        for (const auto &part : parts) {
+            written = written && writeAll(fd, part.first, part.second);
+            bytes += part.second;
+        }
+        int error = errno;
+        if (fd >= 0) close(fd);
+        if (!written && !failed.exchange(true)) std::cout << "couldn't write to " << binPath(bin) << ": " << std::strerror(error) << "\n";
+        bytesWritten += bytes;
+    }
+
+    static bool writeAll(int fd, const void *data, size_t size){
+        auto *at = static_cast<const char*>(data);
+        while (size){
+            ssize_t written = write(fd, at, size);
+            if (written <= 0) return false;
+            at += written;
+            size -= written;
+        }
+        return true;
+    }
+};
+
+// Stands in for the ShardRouter when counting on disk
+template<typename K>
+class BinRouter{
+public:
+    typedef K Kmer;
+    BinFiles &files;
+    FileKmerSet<Kmer> seen;
+    const size_t bufferSize;
+    Kmer *res; // res[bin * bufferSize + i]
+    Kmer *sus;
+    uint32_t *resFill;
+    uint32_t *susFill;
+
+    BinRouter(BinFiles &files, size_t bufferSize, size_t expectedKmers): files(files), seen(expectedKmers), bufferSize(bufferSize){
+        res = new Kmer[files.binCount * bufferSize];
+        sus = new Kmer[files.binCount * bufferSize];
+        resFill = new uint32_t[files.binCount]();
+        susFill = new uint32_t[files.binCount]();
+    }
+    ~BinRouter(){
+        delete[] res;
+        delete[] sus;
+        delete[] resFill;
+        delete[] susFill;
+    }
+    BinRouter(const BinRouter&) = delete;
+    BinRouter &operator=(const BinRouter&) = delete;
+
+    void push(Kmer data, uint32_t fileNr, bool isRes){
+        if (!seen.insert(data, fileNr)) return;
+        size_t bin = binOf(data, files.binCount);
+        if (isRes){
+            res[bin * bufferSize + resFill[bin]] = data;
+            if (++resFill[bin] == bufferSize) write(bin);
+        }
+        else{
+            sus[bin * bufferSize + susFill[bin]] = data;
+            if (++susFill[bin] == bufferSize) write(bin);
+        }
+    }
+
+    void write(size_t bin){
+        files.append(bin, res + bin * bufferSize, resFill[bin], sus + bin * bufferSize, susFill[bin]);
+        resFill[bin] = 0;
+        susFill[bin] = 0;
+    }
+
+    // Writes the blocks that aren't full yet
+    void flush(){
+        for (size_t bin = 0; bin < files.binCount; bin++) {
+            if (resFill[bin] || susFill[bin]) write(bin);
+        }
+    }
+};
+
+// Calls add(kmer, isRes) for every kmer in a bin file, false if the file ends in the middle of a block
+template<typename Kmer, typename Add>
+bool readBin(const MappedFile &bin, Add add){
+    const char *at = bin.data;
+    const char *end = bin.data + bin.size;
+    while (at < end){
+        uint32_t counts[2];
+        if ((size_t) (end - at) < sizeof(counts)) return false;
+        std::memcpy(counts, at, sizeof(counts));
+        at += sizeof(counts);
+        if ((size_t) (end - at) < ((size_t) counts[0] + counts[1]) * sizeof(Kmer)) return false;
+        for (int column = 0; column < 2; column++) {
+            for (uint32_t i = 0; i < counts[column]; i++) {
+                Kmer data;
+                std::memcpy(&data, at, sizeof(Kmer));
+                at += sizeof(Kmer);
+                add(data, column == 0);
+            }
+        }
+    }
+    return true;
+}
+
+// Calls visit(writer, data, size) for every chunk of a bin file the super-k-mers spilled to, false if the file ends in
+// the middle of a chunk or visit returns false
+template<typename Visit>
+bool readChunks(const MappedFile &bin, Visit visit){
+    auto *at = reinterpret_cast<const uint8_t*>(bin.data);
+    const uint8_t *end = at + bin.size;
+    while (at < end){
+        uint32_t header[2];
+        if ((size_t) (end - at) < sizeof(header)) return false;
+        std::memcpy(header, at, sizeof(header));
+        at += sizeof(header);
+        if ((size_t) (end - at) < header[1] || !visit(header[0], at, header[1])) return false;
+        at += header[1];
+    }
+    return true;
+}
+
+#endif
@@ -0,0 +1,260 @@
+/**
+ * Turns fasta text into 2 bit kmers(a = 00, c = 01, g = 10, t = 11).
+ *
+ * The text is encoded 64 bytes at a time by a SIMD kernel that is picked once at startup(AVX2, SSE4.2 or plain C++
+ * on anything else, the SIMD kernels are only compiled on x86). A kernel packs every byte into its 2 bit code and flags which of the 64 bytes are nucleotides,
+ * newlines and anything else. Blocks that only hold nucleotides and line breaks are rolled into kmers straight from
+ * those codes, blocks with a header, an N or such go through the byte by byte scanner.
+ */
+
+#ifndef FASTASCANNER_H
+#define FASTASCANNER_H
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include "kmer.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define SIMD_ENCODERS
+#include <immintrin.h>
+#endif
+
+#define BLOCK_SIZE 64
+
+// Where readFile is in the file, it's carried over from one chunk of a file to the next
+template<typename Kmer>
+struct ScanState{
+    Kmer val{}; // rolling kmer
+    Kmer rc{}; // rolling reverse complement of the kmer, only kept in canonical mode
+    size_t length{}; // how many nucleotides in a row are in val, kmers get counted once there are k
+    bool lineStart = true; // the next character starts a line, a '>' there starts a header
+    bool inHeader{}; // skipping a header line
+};
+
+struct EncodedBlock{
+    uint64_t bases; // bit i is set if byte i is a,c,g or t(either case)
+    uint64_t newlines; // \n
+    uint64_t others; // everything that's neither a nucleotide, \n or \r
+    alignas(64) uint8_t codes[BLOCK_SIZE]; // 2 bit code of every byte, only meaningful where bases is set
+};
+
+// ((c >> 1) ^ (c >> 2)) & 3 happens to be 0,1,2,3 for a,c,g,t in both cases
+inline void encodeBlockScalar(const char *text, EncodedBlock &block){
+    block.bases = 0;
+    block.newlines = 0;
+    block.others = 0;
+    for (int i = 0; i < BLOCK_SIZE; i++) {
+        auto c = static_cast<uint8_t>(text[i]);
+        block.codes[i] = ((c >> 1) ^ (c >> 2)) & 3;
+        uint8_t upper = c & 0xDF;
+        uint64_t bit = (uint64_t) 1 << i;
+        if (upper == 'A' || upper == 'C' || upper == 'G' || upper == 'T') block.bases |= bit;
+        else if (c == '\n') block.newlines |= bit;
+        else if (c != '\r') block.others |= bit;
+    }
+}
+
+#ifdef SIMD_ENCODERS
+__attribute__((target("sse4.2")))
+inline void encodeBlockSse(const char *text, EncodedBlock &block){
+    const __m128i caseMask = _mm_set1_epi8((char) 0xDF);
+    const __m128i codeMask = _mm_set1_epi8(3);
+    uint64_t bases = 0, newlines = 0, returns = 0;
+    for (int i = 0; i < BLOCK_SIZE; i += 16) {
+        __m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i*>(text + i));
+        // the 16 bit shifts pull bits over from the neighbouring byte, but only into bits that get masked away
+        __m128i codes = _mm_and_si128(_mm_xor_si128(_mm_srli_epi16(c, 1), _mm_srli_epi16(c, 2)), codeMask);
+        _mm_store_si128(reinterpret_cast<__m128i*>(block.codes + i), codes);
+        __m128i upper = _mm_and_si128(c, caseMask);
+        __m128i isBase = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(upper, _mm_set1_epi8('A')), _mm_cmpeq_epi8(upper, _mm_set1_epi8('C'))),
+                                      _mm_or_si128(_mm_cmpeq_epi8(upper, _mm_set1_epi8('G')), _mm_cmpeq_epi8(upper, _mm_set1_epi8('T'))));
+        bases |= (uint64_t) (uint16_t) _mm_movemask_epi8(isBase) << i;
+        newlines |= (uint64_t) (uint16_t) _mm_movemask_epi8(_mm_cmpeq_epi8(c, _mm_set1_epi8('\n'))) << i;
+        returns |= (uint64_t) (uint16_t) _mm_movemask_epi8(_mm_cmpeq_epi8(c, _mm_set1_epi8('\r'))) << i;
+    }
+    block.bases = bases;
+    block.newlines = newlines;
+    block.others = ~(bases | newlines | returns);
+}
+
+__attribute__((target("avx2")))
+inline void encodeBlockAvx2(const char *text, EncodedBlock &block){
+    const __m256i caseMask = _mm256_set1_epi8((char) 0xDF);
+    const __m256i codeMask = _mm256_set1_epi8(3);
+    uint64_t bases = 0, newlines = 0, returns = 0;
+    for (int i = 0; i < BLOCK_SIZE; i += 32) {
+        __m256i c = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(text + i));
+        __m256i codes = _mm256_and_si256(_mm256_xor_si256(_mm256_srli_epi16(c, 1), _mm256_srli_epi16(c, 2)), codeMask);
+        _mm256_store_si256(reinterpret_cast<__m256i*>(block.codes + i), codes);
+        __m256i upper = _mm256_and_si256(c, caseMask);
+        __m256i isBase = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(upper, _mm256_set1_epi8('A')), _mm256_cmpeq_epi8(upper, _mm256_set1_epi8('C'))),
+                                         _mm256_or_si256(_mm256_cmpeq_epi8(upper, _mm256_set1_epi8('G')), _mm256_cmpeq_epi8(upper, _mm256_set1_epi8('T'))));
+        bases |= (uint64_t) (uint32_t) _mm256_movemask_epi8(isBase) << i;
+        newlines |= (uint64_t) (uint32_t) _mm256_movemask_epi8(_mm256_cmpeq_epi8(c, _mm256_set1_epi8('\n'))) << i;
+        returns |= (uint64_t) (uint32_t) _mm256_movemask_epi8(_mm256_cmpeq_epi8(c, _mm256_set1_epi8('\r'))) << i;
+    }
+    block.bases = bases;
+    block.newlines = newlines;
+    block.others = ~(bases | newlines | returns);
+}
+
+#endif
+
+typedef void (*EncodeFunction)(const char *text, EncodedBlock &block);
+
+inline EncodeFunction pickEncoder(){
+#ifdef SIMD_ENCODERS
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) return encodeBlockAvx2;
+    if (__builtin_cpu_supports("sse4.2")) return encodeBlockSse;
+#endif
+    return encodeBlockScalar;
+}
+
+// Every encoder this cpu can run, the plain one first
+inline std::vector<EncodeFunction> availableEncoders(){
+    std::vector<EncodeFunction> encoders{encodeBlockScalar};
+#ifdef SIMD_ENCODERS
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse4.2")) encoders.push_back(encodeBlockSse);
+    if (__builtin_cpu_supports("avx2")) encoders.push_back(encodeBlockAvx2);
+#endif
+    return encoders;
+}
+
+inline const char *encoderName(EncodeFunction encoder){
+#ifdef SIMD_ENCODERS
+    if (encoder == encodeBlockAvx2) return "avx2";
+    if (encoder == encodeBlockSse) return "sse4.2";
+#endif
+    return "scalar";
+}
+
+inline EncodeFunction encodeBlock = pickEncoder();
+
+// Shifts a nucleotide into the kmer, and in canonical mode into the reverse complement of the kmer from the other end
+template<bool canonical, typename Kmer>
+inline void shiftIn(Kmer &val, Kmer &rc, size_t code, Kmer mask, unsigned rcShift){
+    val = ((val << 2) | code) & mask;
+    if (canonical) rc = (rc >> 2) | ((Kmer) (3 - code) << rcShift);
+}
+
+// Both strands count as the same kmer in canonical mode, it's stored as the lower of the two
+template<bool canonical, typename Kmer>
+inline Kmer kmerOf(Kmer val, Kmer rc){
+    return canonical && rc < val ? rc : val;
+}
+
+// Byte by byte scanner, used for blocks with headers, N's and such and for the end of a file.
+// Header lines(>...) are skipped and every record starts a new kmer, so no kmer spans two contigs. Anything that
+// isn't a,c,g,t(N and the other IUPAC codes) also starts over after it. \r\n works like \n.
+// Counter is either a DenseCounter or a ShardRouter, Counter::Kmer is the type the kmers are rolled in
+template<bool canonical, typename Counter>
+void scanBytes(const size_t k, const size_t size, uint32_t fileNr, bool isRes, ScanState<typename Counter::Kmer> &state, const char *nucleotides, Counter *table){
+    typedef typename Counter::Kmer Kmer;
+    const Kmer mask = kmerMaskOf<Kmer>(k);
+    const unsigned rcShift = 2 * (k - 1);
+    Kmer val = state.val;
+    Kmer rc = state.rc;
+    size_t length = state.length;
+    bool lineStart = state.lineStart;
+    bool inHeader = state.inHeader;
+    for (size_t i = 0; i < size; i++){
+        if (inHeader){
+            auto *lineEnd = static_cast<const char*>(std::memchr(nucleotides + i, '\n', size - i));
+            if (!lineEnd) break;
+            i = lineEnd - nucleotides;
+            inHeader = false;
+            lineStart = true;
+            continue;
+        }
+        size_t code;
+        switch (nucleotides[i]) {
+            case 'a': case 'A': code = 0; break;
+            case 'c': case 'C': code = 1; break;
+            case 'g': case 'G': code = 2; break;
+            case 't': case 'T': code = 3; break;
+            case '\n':
+                lineStart = true;
+                continue;
+            case '\r':
+                continue;
+            case '>':
+                inHeader = lineStart;
+                lineStart = false;
+                length = 0;
+                continue;
+            default:
+                lineStart = false;
+                length = 0;
+                continue;
+        }
+        shiftIn<canonical>(val, rc, code, mask, rcShift);
+        lineStart = false;
+        if (length < k && ++length < k) continue;
+        table->push(kmerOf<canonical>(val, rc), fileNr, isRes);
+    }
+    state.val = val;
+    state.rc = rc;
+    state.length = length;
+    state.lineStart = lineStart;
+    state.inHeader = inHeader;
+}
+
+template<bool canonical, typename Counter>
+void scanBlocks(const size_t k, const size_t size, uint32_t fileNr, bool isRes, ScanState<typename Counter::Kmer> &state, const char *nucleotides, Counter *table){
+    typedef typename Counter::Kmer Kmer;
+    const Kmer mask = kmerMaskOf<Kmer>(k);
+    const unsigned rcShift = 2 * (k - 1);
+    EncodedBlock block;
+    size_t i = 0;
+    for (; i + BLOCK_SIZE <= size; i += BLOCK_SIZE) {
+        encodeBlock(nucleotides + i, block);
+        if (block.others || state.inHeader){
+            scanBytes<canonical>(k, BLOCK_SIZE, fileNr, isRes, state, nucleotides + i, table);
+            continue;
+        }
+        // only nucleotides and line breaks, \r's are simply left out of both masks
+        Kmer val = state.val;
+        Kmer rc = state.rc;
+        size_t length = state.length;
+        uint64_t bases = block.bases;
+        while (bases && length < k){
+            int j = __builtin_ctzll(bases);
+            bases &= bases - 1;
+            shiftIn<canonical>(val, rc, block.codes[j], mask, rcShift);
+            if (++length < k) continue;
+            table->push(kmerOf<canonical>(val, rc), fileNr, isRes);
+        }
+        if (bases == ~(uint64_t) 0){
+            for (int j = 0; j < BLOCK_SIZE; j++) {
+                shiftIn<canonical>(val, rc, block.codes[j], mask, rcShift);
+                table->push(kmerOf<canonical>(val, rc), fileNr, isRes);
+            }
+            bases = 0;
+        }
+        while (bases){
+            int j = __builtin_ctzll(bases);
+            bases &= bases - 1;
+            shiftIn<canonical>(val, rc, block.codes[j], mask, rcShift);
+            table->push(kmerOf<canonical>(val, rc), fileNr, isRes);
+        }
+        uint64_t lines = block.bases | block.newlines;
+        if (lines) state.lineStart = (block.newlines >> (63 - __builtin_clzll(lines))) & 1;
+        state.val = val;
+        state.rc = rc;
+        state.length = length;
+    }
+    scanBytes<canonical>(k, size - i, fileNr, isRes, state, nucleotides + i, table);
+}
+
+// size may be bigger than the amount of kmers since the file has newlines (\n)
+// canonical keeps the reverse complement rolling next to the kmer in the same pass and counts the lower of the two
+template<typename Counter>
+void readFile(const size_t k, const bool canonical, const size_t size, uint32_t fileNr, bool isRes, ScanState<typename Counter::Kmer> &state, const char *nucleotides, Counter *table){
+    if (canonical) scanBlocks<true>(k, size, fileNr, isRes, state, nucleotides, table);
+    else scanBlocks<false>(k, size, fileNr, isRes, state, nucleotides, table);
+}
+
+#endif
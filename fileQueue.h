@@ -0,0 +1,98 @@
+/**
+ * Hands the genomes out to the reader threads. All files go into one list sorted by size, biggest first, and every
+ * thread takes the next one off the list whenever it's done with the last, so a thread that got small files keeps
+ * going instead of waiting for the others and the big files don't end up at the very end.
+ *
+ * A file that alone is a big part of all the work(a huge assembly when there are only a few genomes) is split into
+ * pieces, one piece per thread at most. The pieces aren't ranges of the file: every piece reads the whole file and only
+ * counts the kmers whose hash falls into its piece. A kmer of a file is then always counted by the same thread, so a
+ * genome still counts every kmer once without the threads sharing a set of the kmers they've seen, and no kmer gets
+ * lost where a range would have been cut. Reading the file again costs little next to counting its kmers. Streamed
+ * files aren't split, they'd be decompressed once per piece.
+ */
+
+#ifndef FILEQUEUE_H
+#define FILEQUEUE_H
+
+#include <algorithm>
+#include <atomic>
+#include <filesystem>
+#include <vector>
+#include "kmer.h"
+
+#define MIN_PIECE_SIZE (8 << 20) // bytes, smaller files are never split
+
+struct GenomeFile{
+    std::filesystem::directory_entry entry;
+    bool resistant;
+    uint32_t fileNr; // unique across all files, starts at 1
+    size_t size; // bytes, gzipped files are taken to be 4 times as big as the file
+    bool streamed;
+};
+
+struct FileTask{
+    const GenomeFile *file;
+    uint32_t piece;
+    uint32_t pieces; // 1 if the file isn't split
+};
+
+class FileQueue{
+public:
+    std::vector<GenomeFile> files;
+    std::vector<FileTask> tasks; // biggest first
+    size_t totalSize{};
+    size_t largestTask{}; // bytes of the biggest file or piece, what a thread has to hold the kmers of at once
+
+    FileQueue(std::vector<GenomeFile> genomeFiles, size_t threadCount): files(std::move(genomeFiles)){
+        for (const GenomeFile &file : files) {
+            totalSize += file.size;
+        }
+        // a piece should be small enough for the other threads to make up for it
+        const size_t pieceSize = std::max<size_t>(MIN_PIECE_SIZE, totalSize / (threadCount * 4));
+        for (const GenomeFile &file : files) {
+            size_t pieces = file.streamed ? 1 : std::clamp<size_t>(file.size / pieceSize, 1, threadCount);
+            for (size_t piece = 0; piece < pieces; piece++) {
+                tasks.push_back({&file, static_cast<uint32_t>(piece), static_cast<uint32_t>(pieces)});
+            }
+            largestTask = std::max(largestTask, file.size / pieces);
+        }
+        // the pieces of a file stay together so they're read while the file is still in the page cache
+        std::stable_sort(tasks.begin(), tasks.end(), [](const FileTask &a, const FileTask &b){
+            return a.file->size / a.pieces > b.file->size / b.pieces;
+        });
+    }
+    FileQueue(const FileQueue&) = delete;
+    FileQueue &operator=(const FileQueue&) = delete;
+
+    // The next file(or piece) to read, nullptr once all of them have been taken
+    const FileTask *next(){
+        size_t i = taken.fetch_add(1, std::memory_order_relaxed);
+        return i < tasks.size() ? &tasks[i] : nullptr;
+    }
+
+    // Hands the files out again from the start, for a second pass over them
+    void reset(){
+        taken.store(0);
+    }
+
+private:
+    std::atomic<size_t> taken{0};
+};
+
+// Stands in front of a counter while a piece of a split file is read, only the piece's kmers get through
+template<typename Counter>
+class PieceFilter{
+public:
+    typedef typename Counter::Kmer Kmer;
+    Counter *counter;
+    const size_t piece;
+    const size_t pieces;
+
+    PieceFilter(Counter *counter, size_t piece, size_t pieces): counter(counter), piece(piece), pieces(pieces){}
+
+    void push(Kmer data, uint32_t fileNr, bool isRes){
+        if (static_cast<size_t>((static_cast<unsigned __int128>(mixHash(data)) * pieces) >> 64) == piece) counter->push(data, fileNr, isRes);
+    }
+};
+
+#endif
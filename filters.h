@@ -0,0 +1,175 @@
+/**
+ * Which kmers make it into the output(--min-presence, --min-diff, --max-p). The filters only look at res and sus, so
+ * they're applied to the finished counts right before sorting, on the thread that owns the kmers.
+ *
+ * The p value of a kmer compares how often it's in resistant genomes against how often it's in susceptible ones,
+ * either with Fisher's exact test(two sided) or a chi-square test without continuity correction. It only depends on
+ * res and sus, and for the kmers in n genomes both tests get less significant the closer res gets to the split that's
+ * expected. So the significant res values of n are the lowest few and the highest few, and only how many of each is
+ * kept: two numbers per n instead of a table of every pair, which would be(res genomes + 1) * (sus genomes + 1) big.
+ * They're worked out the first time a kmer in n genomes comes along, walking in from both ends and stopping at the
+ * first split that isn't significant, so a big collection doesn't pay for the splits no kmer has.
+ */
+
+#ifndef FILTERS_H
+#define FILTERS_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+enum class Test{ fisher, chiSquare };
+
+class KmerFilter{
+public:
+    const uint32_t minPresence; // res + sus
+    const uint32_t minDiff; // |res - sus|
+    const uint32_t resAmount;
+    const uint32_t susAmount;
+
+    KmerFilter(uint32_t minPresence, uint32_t minDiff, double maxP, Test test, uint32_t resAmount, uint32_t susAmount):
+            minPresence(minPresence), minDiff(minDiff), resAmount(resAmount), susAmount(susAmount), maxP(maxP), test(test){
+        if (maxP >= 1) return;
+        const uint32_t total = resAmount + susAmount;
+        tails = new Tails[(size_t) total + 1];
+        computed = new std::once_flag[(size_t) total + 1];
+        if (test != Test::fisher) return;
+        logFactorial.assign((size_t) total + 1, 0);
+        for (uint32_t i = 1; i <= total; i++) {
+            logFactorial[i] = logFactorial[i - 1] + std::log((double) i);
+        }
+    }
+    ~KmerFilter(){
+        delete[] tails;
+        delete[] computed;
+    }
+    KmerFilter(const KmerFilter&) = delete;
+    KmerFilter &operator=(const KmerFilter&) = delete;
+
+    bool active() const{
+        return minPresence > 1 || minDiff > 0 || tails;
+    }
+
+    // Any number of threads can ask at once, the first one to need n works its tails out
+    bool passes(uint32_t res, uint32_t sus) const{
+        if (res + sus < minPresence) return false;
+        if ((res > sus ? res - sus : sus - res) < minDiff) return false;
+        return !tails || significant(res, sus);
+    }
+
+private:
+    // How many of the lowest and of the highest res values of n are significant
+    struct Tails{
+        uint32_t low;
+        uint32_t high;
+    };
+
+    const double maxP;
+    const Test test;
+    Tails *tails{}; // one per n = res + sus, nullptr without --max-p
+    std::once_flag *computed{};
+    std::vector<double> logFactorial; // only for Fisher's test
+
+    bool significant(uint32_t res, uint32_t sus) const{
+        const uint32_t n = res + sus;
+        std::call_once(computed[n], [&]{ tails[n] = test == Test::fisher ? fisherTails(n) : chiSquareTails(n); });
+        const uint32_t lowest = n > susAmount ? n - susAmount : 0, highest = std::min(n, resAmount);
+        return res - lowest < tails[n].low || highest - res < tails[n].high;
+    }
+
+    // A kmer in n genomes splits them into res ones and n - res sus ones, which is hypergeometric. The two sided p is
+    // the sum of every split that's at most as likely as the one that was seen. The splits get more likely from both
+    // ends inwards, so taking the less likely end every time goes through them in order and the p values only grow.
+    // The far ends are significant anyway and add nothing to the sums, the walk starts where they stop mattering
+    Tails fisherTails(uint32_t n) const{
+        if (n == 0) return Tails{0, 0};
+        const uint32_t total = resAmount + susAmount;
+        auto logChoose = [&](uint32_t of, uint32_t r){
+            return logFactorial[of] - logFactorial[r] - logFactorial[of - r];
+        };
+        auto logProbability = [&](int64_t res){
+            auto r = static_cast<uint32_t>(res);
+            return logChoose(resAmount, r) + logChoose(susAmount, n - r) - logChoose(total, n);
+        };
+        auto probability = [&](int64_t res){
+            return std::exp(logProbability(res));
+        };
+        const int64_t lowest = n > susAmount ? n - susAmount : 0, highest = std::min(n, resAmount);
+        const int64_t mode = std::clamp<int64_t>((int64_t) (((uint64_t) n + 1) * (resAmount + 1) / (total + 2)), lowest, highest);
+        // all the splits less likely than this together are still far below maxP
+        const double negligible = std::log(maxP * 1e-9 / (double) (highest - lowest + 1));
+        int64_t left = lowest, right = mode;
+        while (left < right){
+            int64_t middle = left + (right - left) / 2;
+            if (logProbability(middle) >= negligible) right = middle;
+            else left = middle + 1;
+        }
+        int64_t upper = highest;
+        right = mode;
+        while (right < upper){
+            int64_t middle = upper - (upper - right) / 2;
+            if (logProbability(middle) >= negligible) right = middle;
+            else upper = middle - 1;
+        }
+        Tails found{static_cast<uint32_t>(left - lowest), static_cast<uint32_t>(highest - right)};
+        // left..right haven't been decided yet, aheadLeft..aheadRight aren't in sum yet
+        int64_t aheadLeft = left, aheadRight = right;
+        double leftP = probability(left), rightP = probability(right);
+        double aheadLeftP = leftP, aheadRightP = rightP;
+        double sum = 0;
+        while (left <= right){
+            bool fromLeft = leftP <= rightP;
+            // rounding makes splits that are equally likely come out slightly different
+            double asLikely = (fromLeft ? leftP : rightP) * (1 + 1e-7);
+            while (aheadLeft <= aheadRight && std::min(aheadLeftP, aheadRightP) <= asLikely){
+                if (aheadLeftP <= aheadRightP){
+                    sum += aheadLeftP;
+                    if (++aheadLeft <= aheadRight) aheadLeftP = probability(aheadLeft);
+                }
+                else{
+                    sum += aheadRightP;
+                    if (aheadLeft <= --aheadRight) aheadRightP = probability(aheadRight);
+                }
+            }
+            if (sum > maxP) break;
+            if (fromLeft){
+                found.low++;
+                if (++left <= right) leftP = probability(left);
+            }
+            else{
+                found.high++;
+                if (left <= --right) rightP = probability(right);
+            }
+        }
+        return found;
+    }
+
+    // res * (susAmount - sus) - sus * (resAmount - res) only grows the further res is from the expected split
+    Tails chiSquareTails(uint32_t n) const{
+        Tails found{0, 0};
+        const double total = resAmount + susAmount;
+        double present = n, absent = total - present;
+        if (present == 0 || absent == 0 || resAmount == 0 || susAmount == 0) return found;
+        auto isSignificant = [&](int64_t res){
+            auto sus = static_cast<uint32_t>(n - res);
+            double cross = (double) res * (susAmount - sus) - (double) sus * (resAmount - res);
+            double chiSquare = total * cross * cross / (present * absent * resAmount * susAmount);
+            // one degree of freedom
+            return std::erfc(std::sqrt(chiSquare / 2)) <= maxP;
+        };
+        int64_t left = n > susAmount ? n - susAmount : 0, right = std::min(n, resAmount);
+        while (left <= right && isSignificant(left)){
+            found.low++;
+            left++;
+        }
+        while (left <= right && isSignificant(right)){
+            found.high++;
+            right--;
+        }
+        return found;
+    }
+};
+
+#endif
@@ -0,0 +1,64 @@
+/**
+ * Finding a kmer in a sorted array of them(the presence matrix and the count index). The kmers are about evenly
+ * spread over 0..4^k, so the top bits of a kmer point into a directory that has the first row of every value of those
+ * bits, and only the few rows between two entries of the directory are binary searched. A lookup touches the directory
+ * and one or two pages of the keys, however many kmers there are.
+ */
+
+#ifndef KEYDIRECTORY_H
+#define KEYDIRECTORY_H
+
+#include <algorithm>
+#include <cstdint>
+
+#define MAX_DIRECTORY_BITS 24 // the directory has at most 2^24 entries(128 MB)
+
+inline uint64_t alignedTo(uint64_t offset, uint64_t alignment){
+    return (offset + alignment - 1) / alignment * alignment;
+}
+
+template<typename Kmer>
+class KeyDirectory{
+public:
+    unsigned bits{};
+    const uint64_t *starts{}; // first row of every value of the top bits, one more at the end
+
+    KeyDirectory() = default;
+    KeyDirectory(size_t k, unsigned bits, const uint64_t *starts): bits(bits), starts(starts), shift(static_cast<unsigned>(2 * k - bits)){}
+
+    // About one kmer per entry, a short search after the directory either way
+    static unsigned bitsFor(size_t rows, size_t k){
+        unsigned bits = 1;
+        while (bits < MAX_DIRECTORY_BITS && bits < 2 * k && ((size_t) 1 << bits) < rows) bits++;
+        return bits;
+    }
+
+    static size_t entriesFor(unsigned bits){
+        return ((size_t) 1 << bits) + 1;
+    }
+
+    // Fills the directory in to while the keys go by in order, row is where kmer is in them. finish sets the rest
+    void add(uint64_t *to, Kmer kmer, size_t row){
+        size_t bucket = static_cast<size_t>(kmer >> shift);
+        while (filled <= bucket) to[filled++] = row;
+    }
+
+    void finish(uint64_t *to, size_t rows){
+        const size_t entries = entriesFor(bits);
+        while (filled < entries) to[filled++] = rows;
+    }
+
+    // rows if the kmer isn't in keys
+    size_t rowOf(const Kmer *keys, size_t rows, Kmer kmer) const{
+        size_t bucket = static_cast<size_t>(kmer >> shift);
+        const Kmer *begin = keys + starts[bucket], *end = keys + starts[bucket + 1];
+        const Kmer *found = std::lower_bound(begin, end, kmer);
+        return found != end && *found == kmer ? found - keys : rows;
+    }
+
+private:
+    unsigned shift{};
+    size_t filled{};
+};
+
+#endif
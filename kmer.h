@@ -0,0 +1,85 @@
+/**
+ * How kmers are stored. A kmer takes 2 bits per nucleotide, so k <= 32 fits into one 64 bit word and is stored as a
+ * plain size_t, anything up to k = 64 takes two words(unsigned __int128). The tables, scanners and writers are
+ * templates over the kmer type and main picks the instantiation from k once, so k <= 32 runs exactly the same code
+ * it did before longer kmers were possible.
+ */
+
+#ifndef KMER_H
+#define KMER_H
+
+#include <cstdint>
+
+#define MAX_WORDS 2 // biggest kmer in 64 bit words
+#define MAX_K (32 * MAX_WORDS)
+
+template<unsigned words> struct KmerWord;
+template<> struct KmerWord<1>{ typedef size_t type; };
+template<> struct KmerWord<2>{ typedef unsigned __int128 type; };
+
+// how many 64 bit words a kmer of length k needs
+inline unsigned wordsFor(size_t k){
+    return (k + 31) / 32;
+}
+
+// murmur3 finalizer, consecutive kmers differ only in the lowest bits so they need to be spread out
+inline size_t mixHash(size_t x){
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+    x *= 0xc4ceb9fe1a85ec53ULL;
+    x ^= x >> 33;
+    return x;
+}
+
+inline size_t mixHash(unsigned __int128 x){
+    return mixHash(static_cast<size_t>(x) ^ mixHash(static_cast<size_t>(x >> 64)));
+}
+
+// 2k low bits set. Shifting a 1 past the width of the type is undefined, so a full kmer is handled on its own
+template<typename Kmer>
+inline Kmer kmerMaskOf(size_t k){
+    return 2 * k >= sizeof(Kmer) * 8 ? ~(Kmer) 0 : ((Kmer) 1 << (2 * k)) - 1;
+}
+
+// The reverse complement of a kmer of length k, for where it can't be rolled along with the kmer
+template<typename Kmer>
+inline Kmer reverseComplementOf(Kmer kmer, size_t k){
+    Kmer rc = 0;
+    for (size_t i = 0; i < k; i++) {
+        rc = (rc << 2) | (3 - (kmer & 3));
+        kmer >>= 2;
+    }
+    return rc;
+}
+
+// Decimal text straight into a buffer, this is what the output is made of so it skips std::ostream
+inline char *writeNumber(size_t value, char *to){
+    char digits[20];
+    int n = 0;
+    do{
+        digits[n++] = static_cast<char>('0' + value % 10);
+        value /= 10;
+    } while (value);
+    while (n) *to++ = digits[--n];
+    return to;
+}
+
+inline char *writeKmer(size_t kmer, char *to){
+    return writeNumber(kmer, to);
+}
+
+// there's no standard way to print an __int128, only kmers that don't fit into one word take the slow division
+inline char *writeKmer(unsigned __int128 kmer, char *to){
+    if (kmer <= ~(size_t) 0) return writeNumber(static_cast<size_t>(kmer), to);
+    char digits[40];
+    int n = 0;
+    while (kmer){
+        digits[n++] = static_cast<char>('0' + static_cast<int>(kmer % 10));
+        kmer /= 10;
+    }
+    while (n) *to++ = digits[--n];
+    return to;
+}
+
+#endif
@@ -0,0 +1,252 @@
+/**
+ * Flat open-addressing table that stores one slot per distinct kmer.
+ *
+ * Memory per kmer: a slot is 24 bytes (8 byte kmer, 4 byte res count, 4 byte sus count, 4 byte last file,
+ * 4 byte flags). The table doubles once it is 70% full, so it sits between 35% and 70% load, which works out to
+ * 34-69 bytes per distinct kmer (about 48 on average). The old chained table needed a 48 byte malloc chunk per
+ * Node plus two bucket pointers per kmer, and twice that while resizing. Kmers longer than 32 take two words, their
+ * slots are 32 bytes(46-91 bytes per kmer).
+ *
+ * A slot is empty when both of its counts are 0, every stored kmer has been seen in at least one file.
+ *
+ * The slot arrays come from slabMemory.h, a big table is one mapping of huge pages that grows in place and is given
+ * back with a single munmap, so freeing a table costs the same no matter how many kmers are in it.
+ */
+
+#ifndef KMERTABLE_H
+#define KMERTABLE_H
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <utility>
+#include "kmer.h"
+#include "slabMemory.h"
+#include "phenotypes.h"
+
+#define MAX_LOAD_NUMERATOR 7 // table grows when count > capacity * 7/10
+#define MAX_LOAD_DENOMINATOR 10
+#define SLOT_DIRTY 1 // slot still has to be moved to its new position during a rehash
+
+template<typename Kmer>
+struct Slot{
+    Kmer data;
+    uint32_t resOccurences;
+    uint32_t susOccurences;
+    uint32_t fileNr; // last file that counted this kmer
+    uint32_t flags; // SLOT_DIRTY, and above it the row of the kmer's phenotype counters with several phenotypes
+};
+
+template<typename Kmer>
+inline bool isOccupied(const Slot<Kmer> &slot){
+    return (slot.resOccurences | slot.susOccurences) != 0;
+}
+
+template<typename Kmer>
+class KmerTable{
+public:
+    Slot<Kmer> *slots{};
+    size_t capacity{}; // always a power of two
+    size_t count{};
+    size_t grows{}; // for --stats
+    double growMs{};
+    PhenotypeCounters *phenotypes{}; // counters per antibiotic, only with several phenotypes. Owned by the table
+
+    explicit KmerTable(size_t expectedKmers){
+        capacity = 1024;
+        while (capacity * MAX_LOAD_NUMERATOR < expectedKmers * MAX_LOAD_DENOMINATOR) capacity <<= 1;
+        slots = static_cast<Slot<Kmer>*>(allocateZeroed(capacity * sizeof(Slot<Kmer>)));
+    }
+    ~KmerTable(){
+        releaseZeroed(slots, capacity * sizeof(Slot<Kmer>));
+        delete phenotypes;
+    }
+    KmerTable(const KmerTable&) = delete;
+    KmerTable &operator=(const KmerTable&) = delete;
+
+    // Counts the kmer for the given file, a file only counts once per kmer
+    void push(Kmer data, uint32_t fileNr, bool isRes){
+        size_t mask = capacity - 1;
+        size_t i = mixHash(data) & mask;
+        while (isOccupied(slots[i])){
+            if (slots[i].data == data){
+                if (slots[i].fileNr != fileNr){
+                    if (isRes) slots[i].resOccurences++;
+                    else slots[i].susOccurences++;
+                    slots[i].fileNr = fileNr;
+                    if (phenotypes) phenotypes->add(slots[i].flags >> SLOT_ROW_SHIFT, fileNr);
+                }
+                return;
+            }
+            i = (i + 1) & mask;
+        }
+        slots[i].data = data;
+        slots[i].resOccurences = isRes;
+        slots[i].susOccurences = !isRes;
+        slots[i].fileNr = fileNr;
+        if (phenotypes) slots[i].flags = phenotypes->newRow(fileNr) << SLOT_ROW_SHIFT;
+        if (++count * MAX_LOAD_DENOMINATOR > capacity * MAX_LOAD_NUMERATOR) grow();
+    }
+
+    // Adds the counts of a slot from another table
+    void add(const Slot<Kmer> &other){
+        size_t mask = capacity - 1;
+        size_t i = mixHash(other.data) & mask;
+        while (isOccupied(slots[i])){
+            if (slots[i].data == other.data){
+                slots[i].resOccurences += other.resOccurences;
+                slots[i].susOccurences += other.susOccurences;
+                return;
+            }
+            i = (i + 1) & mask;
+        }
+        slots[i] = other;
+        slots[i].flags = 0;
+        if (++count * MAX_LOAD_DENOMINATOR > capacity * MAX_LOAD_NUMERATOR) grow();
+    }
+
+    // Doubles the table and rehashes it in place. The slot array is extended(mremap for big tables) instead of
+    // allocating a second table, then every old slot is marked dirty and moved to its new position. A dirty slot
+    // counts as free when looking for a target, if the target is dirty the two slots get swapped and the swapped in
+    // kmer is handled next. Slots that are already in place never move again so their probe chains stay intact.
+    void grow(){
+        auto start = std::chrono::steady_clock::now();
+        size_t oldCapacity = capacity;
+        slots = static_cast<Slot<Kmer>*>(growZeroed(slots, oldCapacity * sizeof(Slot<Kmer>), (oldCapacity << 1) * sizeof(Slot<Kmer>)));
+        capacity = oldCapacity << 1;
+        for (size_t i = 0; i < oldCapacity; i++) {
+            if (isOccupied(slots[i])) slots[i].flags |= SLOT_DIRTY;
+        }
+        size_t mask = capacity - 1;
+        size_t i = 0;
+        while (i < capacity){
+            if (!(slots[i].flags & SLOT_DIRTY)){
+                i++;
+                continue;
+            }
+            size_t target = mixHash(slots[i].data) & mask;
+            while (target != i && isOccupied(slots[target]) && !(slots[target].flags & SLOT_DIRTY)){
+                target = (target + 1) & mask;
+            }
+            if (target == i){
+                slots[i].flags &= ~SLOT_DIRTY;
+                i++;
+            }
+            else if (!isOccupied(slots[target])){
+                slots[target] = slots[i];
+                slots[target].flags &= ~SLOT_DIRTY;
+                slots[i] = Slot<Kmer>{};
+                i++;
+            }
+            else{
+                // target is waiting to be moved as well, take its place and handle the kmer that was there
+                std::swap(slots[i], slots[target]);
+                slots[target].flags &= ~SLOT_DIRTY;
+            }
+        }
+        grows++;
+        growMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    // Adds up how far every kmer sits from the slot its hash points to, only works before compact
+    size_t probeLengths(size_t &longest) const{
+        size_t mask = capacity - 1, total = 0;
+        longest = 0;
+        for (size_t i = 0; i < capacity; i++) {
+            if (!isOccupied(slots[i])) continue;
+            size_t distance = (i - mixHash(slots[i].data)) & mask;
+            total += distance;
+            longest = std::max(longest, distance);
+        }
+        return total;
+    }
+
+    // Empties the table so it can be used again without giving its memory back, and makes room for expectedKmers
+    void clear(size_t expectedKmers){
+        std::memset(slots, 0, capacity * sizeof(Slot<Kmer>));
+        size_t needed = capacity;
+        while (needed * MAX_LOAD_NUMERATOR < expectedKmers * MAX_LOAD_DENOMINATOR) needed <<= 1;
+        if (needed != capacity){
+            slots = static_cast<Slot<Kmer>*>(growZeroed(slots, capacity * sizeof(Slot<Kmer>), needed * sizeof(Slot<Kmer>)));
+            capacity = needed;
+        }
+        count = 0;
+        grows = 0;
+        growMs = 0;
+    }
+
+    // Moves all kmers to the front of the slot array and returns how many there are.
+    // The table can't be searched afterwards, it's only meant for writing the kmers out
+    size_t compact(){
+        size_t j = 0;
+        for (size_t i = 0; i < capacity; i++) {
+            if (isOccupied(slots[i])) slots[j++] = slots[i];
+        }
+        return j;
+    }
+};
+
+// Remembers which kmers were already seen in the file that is currently being read, so every kmer leaves a reader
+// thread only once per file. Slots of older files count as empty, moving on to the next file doesn't need a clear.
+template<typename Kmer>
+class FileKmerSet{
+public:
+    struct Entry{
+        Kmer data;
+        uint32_t fileNr; // 0 means the slot was never used, file numbers start at 1
+    };
+    Entry *entries{};
+    size_t capacity{};
+    size_t count{}; // kmers of currentFile
+    uint32_t currentFile{};
+
+    explicit FileKmerSet(size_t expectedKmers){
+        capacity = 1024;
+        while (capacity * MAX_LOAD_NUMERATOR < expectedKmers * MAX_LOAD_DENOMINATOR) capacity <<= 1;
+        entries = static_cast<Entry*>(allocateZeroed(capacity * sizeof(Entry)));
+    }
+    ~FileKmerSet(){
+        releaseZeroed(entries, capacity * sizeof(Entry));
+    }
+    FileKmerSet(const FileKmerSet&) = delete;
+    FileKmerSet &operator=(const FileKmerSet&) = delete;
+
+    // true if the kmer wasn't seen in this file yet
+    bool insert(Kmer data, uint32_t fileNr){
+        if (fileNr != currentFile){
+            currentFile = fileNr;
+            count = 0;
+        }
+        size_t mask = capacity - 1;
+        size_t i = mixHash(data) & mask;
+        while (entries[i].fileNr == fileNr){
+            if (entries[i].data == data) return false;
+            i = (i + 1) & mask;
+        }
+        entries[i].data = data;
+        entries[i].fileNr = fileNr;
+        if (++count * MAX_LOAD_DENOMINATOR > capacity * MAX_LOAD_NUMERATOR) grow();
+        return true;
+    }
+
+    // Only the kmers of the current file are kept, everything else is stale anyway
+    void grow(){
+        size_t newCapacity = capacity << 1;
+        auto *newEntries = static_cast<Entry*>(allocateZeroed(newCapacity * sizeof(Entry)));
+        size_t mask = newCapacity - 1;
+        for (size_t j = 0; j < capacity; j++) {
+            if (entries[j].fileNr != currentFile) continue;
+            size_t i = mixHash(entries[j].data) & mask;
+            while (newEntries[i].fileNr == currentFile) i = (i + 1) & mask;
+            newEntries[i] = entries[j];
+        }
+        releaseZeroed(entries, capacity * sizeof(Entry));
+        entries = newEntries;
+        capacity = newCapacity;
+    }
+};
+
+#endif
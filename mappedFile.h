@@ -0,0 +1,53 @@
+/**
+ * Read only memory mapping of a whole file. The kernel reads the pages in as they get scanned and they're shared
+ * through the page cache, so a genome is never copied into a buffer of our own. Files that are looked things up in
+ * (the count index) are mapped for random access instead and read in whole up front.
+ */
+
+#ifndef MAPPEDFILE_H
+#define MAPPEDFILE_H
+
+#include <string>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+class MappedFile{
+public:
+    const char *data{};
+    size_t size{};
+    bool opened{};
+
+    explicit MappedFile(const std::string &path, bool sequential = true){
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0) return;
+        struct stat info{};
+        if (fstat(fd, &info) == 0){
+            size = info.st_size;
+            opened = true;
+            if (size > 0){
+                // the file is read front to back once, let the kernel read ahead aggressively and drop pages behind us
+                if (sequential) posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+                void *mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+                if (mapping == MAP_FAILED){
+                    opened = false;
+                    size = 0;
+                }
+                else{
+                    madvise(mapping, size, sequential ? MADV_SEQUENTIAL : MADV_RANDOM);
+                    madvise(mapping, size, MADV_WILLNEED);
+                    data = static_cast<const char*>(mapping);
+                }
+            }
+        }
+        close(fd);
+    }
+    ~MappedFile(){
+        if (data) munmap(const_cast<char*>(data), size);
+    }
+    MappedFile(const MappedFile&) = delete;
+    MappedFile &operator=(const MappedFile&) = delete;
+};
+
+#endif
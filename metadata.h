@@ -0,0 +1,253 @@
+/**
+ * meta.csv: which genomes are resistant and which are susceptible. The file is mapped and walked once, only the id
+ * and phenotype columns of a row are looked at and the rest of the row is skipped with memchr. Fields can be quoted,
+ * quoted fields can hold commas, line breaks and "" for a quote. The columns default to the second(genome id) and the
+ * fifth(phenotype) like the files this was written for, --id-column and --phenotype-column take a number counting
+ * from 1 or the name of the column in the header.
+ *
+ * A phenotype is "resistant" or "susceptible"(any case, "R"/"S" work too), rows with anything else are ignored. When
+ * a genome is in several rows the first one counts, the others are only counted for the report, which also lists the
+ * genome files that aren't in meta.csv and the rows that have no file.
+ *
+ * Several phenotypes(phenotypes.h) come either from several columns of one row per genome(--phenotype-columns, the
+ * column names are the antibiotics) or from one row per genome and antibiotic(--antibiotic-column, every value of that
+ * column is an antibiotic and the phenotype is in --phenotype-column). The first row counts per genome and antibiotic.
+ */
+
+#ifndef METADATA_H
+#define METADATA_H
+
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "mappedFile.h"
+
+#define REPORT_EXAMPLES 5 // names listed per kind of mismatch, the rest is only counted
+
+struct GenomeMetadata{
+    std::vector<int8_t> phenotypes; // per antibiotic: 1 resistant, 0 susceptible or -1, can be shorter than antibiotics
+    bool matched; // a genome file has this id
+};
+
+class Metadata{
+public:
+    const std::string path; // meta.csv or whatever --meta points to
+    std::vector<std::string> antibiotics; // one unnamed phenotype unless several were asked for
+    std::unordered_map<std::string, GenomeMetadata> genomes;
+    size_t rows{};
+    size_t ignoredRows{}; // no id or a phenotype that isn't resistant or susceptible
+    size_t repeatedRows{}; // the genome(and antibiotic) was in an earlier row already
+    size_t conflictingRows{}; // and with the other phenotype
+    std::vector<std::string> unmatchedFiles;
+    size_t unmatchedFileCount{};
+    std::string error; // empty if the file could be read
+
+    // phenotypeColumns has one column, or one per antibiotic. antibioticColumn is empty unless meta.csv has a row per
+    // genome and antibiotic
+    Metadata(const std::string &path, const std::string &idColumn, const std::vector<std::string> &phenotypeColumns, const std::string &antibioticColumn): path(path){
+        MappedFile file(path);
+        if (!file.opened){
+            error = "couldn't open " + path;
+            return;
+        }
+        const char *at = file.data, *end = file.data + file.size;
+        std::vector<std::string> header;
+        at = readRow(at, end, header, SIZE_MAX);
+        std::vector<std::string> wanted = phenotypeColumns;
+        wanted.push_back(idColumn);
+        if (!antibioticColumn.empty()) wanted.push_back(antibioticColumn);
+        for (const std::string &column : wanted) {
+            if (columnIndex(column, header) == SIZE_MAX){
+                error = path + " has no column " + column;
+                return;
+            }
+        }
+        idIndex = columnIndex(idColumn, header);
+        size_t lastColumn = idIndex;
+        for (const std::string &column : phenotypeColumns) {
+            phenotypeIndices.push_back(columnIndex(column, header));
+            lastColumn = std::max(lastColumn, phenotypeIndices.back());
+            if (phenotypeColumns.size() > 1) antibiotics.push_back(header.size() > phenotypeIndices.back() ? header[phenotypeIndices.back()] : column);
+        }
+        std::unordered_map<std::string, size_t> antibioticIndices;
+        if (!antibioticColumn.empty()){
+            antibioticIndex = columnIndex(antibioticColumn, header);
+            lastColumn = std::max(lastColumn, antibioticIndex);
+        }
+        else if (antibiotics.empty()) antibiotics.emplace_back();
+        // a row takes 100 bytes or more, reserving for that keeps the map from rehashing
+        genomes.reserve(file.size / 100);
+        std::vector<std::string> fields;
+        while (at < end){
+            at = readRow(at, end, fields, lastColumn);
+            if (fields.size() == 1 && fields[0].empty()) continue; // empty line
+            rows++;
+            if (fields.size() <= lastColumn || fields[idIndex].empty()){
+                ignoredRows++;
+                continue;
+            }
+            size_t firstAntibiotic = 0;
+            if (antibioticIndex != SIZE_MAX){
+                auto added = antibioticIndices.emplace(fields[antibioticIndex], antibiotics.size());
+                if (added.second) antibiotics.push_back(fields[antibioticIndex]);
+                firstAntibiotic = added.first->second;
+            }
+            bool any = false;
+            GenomeMetadata *genome = nullptr;
+            for (size_t i = 0; i < phenotypeIndices.size(); i++) {
+                int phenotype = phenotypeOf(fields[phenotypeIndices[i]]);
+                if (phenotype < 0) continue;
+                if (!genome) genome = &genomes[fields[idIndex]];
+                set(*genome, firstAntibiotic + i, phenotype);
+                any = true;
+            }
+            ignoredRows += !any;
+        }
+    }
+
+    // nullptr if the genome isn't in meta.csv, the file is noted for the report either way
+    const GenomeMetadata *match(const std::string &id, const std::string &fileName){
+        auto found = genomes.find(id);
+        if (found == genomes.end()){
+            if (unmatchedFileCount++ < REPORT_EXAMPLES) unmatchedFiles.push_back(fileName);
+            return nullptr;
+        }
+        found->second.matched = true;
+        return &found->second;
+    }
+
+    void report() const{
+        std::vector<std::string> missingFiles;
+        size_t missingFileCount = 0;
+        for (const auto &genome : genomes) {
+            if (genome.second.matched) continue;
+            if (missingFileCount++ < REPORT_EXAMPLES) missingFiles.push_back(genome.first);
+        }
+        std::cout << path << ": " << rows << " rows, " << genomes.size() << " genomes";
+        if (antibiotics.size() > 1) std::cout << ", " << antibiotics.size() << " antibiotics";
+        if (ignoredRows) std::cout << ", " << ignoredRows << " rows without an id or a resistant/susceptible phenotype";
+        if (repeatedRows) std::cout << ", " << repeatedRows << " rows repeat a genome(" << conflictingRows << " with the other phenotype, the first row counts)";
+        std::cout << "\n";
+        list(unmatchedFileCount, "files aren't in " + path, unmatchedFiles);
+        list(missingFileCount, "genomes in " + path + " have no file", missingFiles);
+    }
+
+private:
+    size_t idIndex{};
+    std::vector<size_t> phenotypeIndices;
+    size_t antibioticIndex = SIZE_MAX;
+
+    void set(GenomeMetadata &genome, size_t antibiotic, int phenotype){
+        if (genome.phenotypes.size() <= antibiotic) genome.phenotypes.resize(antibiotic + 1, -1);
+        int8_t &known = genome.phenotypes[antibiotic];
+        if (known < 0){
+            known = static_cast<int8_t>(phenotype);
+            return;
+        }
+        repeatedRows++;
+        conflictingRows += known != phenotype;
+    }
+
+    static void list(size_t count, const std::string &what, std::vector<std::string> examples){
+        if (!count) return;
+        std::sort(examples.begin(), examples.end());
+        std::cout << count << " " << what << ":";
+        for (const std::string &example : examples) {
+            std::cout << " " << example;
+        }
+        std::cout << (count > examples.size() ? " ...\n" : "\n");
+    }
+
+    // Reads the fields of one row up to lastColumn and returns where the next row starts
+    static const char *readRow(const char *at, const char *end, std::vector<std::string> &fields, size_t lastColumn){
+        fields.clear();
+        fields.emplace_back();
+        bool quoted = false;
+        bool skipping = false; // past lastColumn, only looking for the end of the row
+        while (at < end){
+            char c = *at++;
+            if (quoted){
+                if (c != '"'){
+                    if (!skipping) fields.back() += c;
+                }
+                else if (at < end && *at == '"'){
+                    if (!skipping) fields.back() += '"';
+                    at++;
+                }
+                else quoted = false;
+            }
+            else if (c == '"') quoted = true;
+            else if (c == '\n') break;
+            else if (skipping) continue;
+            else if (c == ','){
+                if (fields.size() <= lastColumn){
+                    fields.emplace_back();
+                    continue;
+                }
+                // the rest of the row isn't needed, it can be jumped over unless there's a quoted line break in it
+                skipping = true;
+                auto *lineEnd = static_cast<const char*>(std::memchr(at, '\n', end - at));
+                if (!lineEnd) lineEnd = end;
+                if (!std::memchr(at, '"', lineEnd - at)){
+                    at = lineEnd < end ? lineEnd + 1 : end;
+                    break;
+                }
+            }
+            else if (c != '\r') fields.back() += c;
+        }
+        for (std::string &field : fields) {
+            trim(field);
+        }
+        return at;
+    }
+
+    static void trim(std::string &text){
+        size_t first = text.find_first_not_of(" \t");
+        if (first == std::string::npos){
+            text.clear();
+            return;
+        }
+        text.erase(text.find_last_not_of(" \t") + 1);
+        text.erase(0, first);
+    }
+
+    static std::string lowered(std::string text){
+        std::transform(text.begin(), text.end(), text.begin(), [](unsigned char c){ return std::tolower(c); });
+        return text;
+    }
+
+    // 1 resistant, 0 susceptible, -1 anything else
+    static int phenotypeOf(const std::string &text){
+        std::string value = lowered(text);
+        if (value == "resistant" || value == "r") return 1;
+        if (value == "susceptible" || value == "s") return 0;
+        return -1;
+    }
+
+    // A number counts from 1, anything else is the name of a column in the header. SIZE_MAX if there's no such column
+    static size_t columnIndex(const std::string &column, const std::vector<std::string> &header){
+        if (!column.empty() && std::all_of(column.begin(), column.end(), ::isdigit)){
+            size_t number = std::stoul(column);
+            return number ? number - 1 : SIZE_MAX;
+        }
+        for (size_t i = 0; i < header.size(); i++) {
+            if (lowered(header[i]) == lowered(column)) return i;
+        }
+        return SIZE_MAX;
+    }
+};
+
+// The id of a genome file: its name without .gz and the extension, so ID.fna, ID.fasta and ID.fna.gz are all ID
+inline std::string genomeIdOf(const std::string &fileName){
+    std::string name = fileName;
+    if (name.size() > 3 && name.compare(name.size() - 3, 3, ".gz") == 0) name.resize(name.size() - 3);
+    size_t dot = name.rfind('.');
+    return dot == std::string::npos || dot == 0 ? name : name.substr(0, dot);
+}
+
+#endif
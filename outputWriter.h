@@ -0,0 +1,121 @@
+/**
+ * Parallel text output. The rows of counts.csv are cut into parts that get formatted on every thread at once, each
+ * thread into its own buffer, and the buffers are written in part order so the file is the same as if one thread had
+ * written it. Thread t takes parts t, t + threads, t + 2 * threads..., so only one buffer per thread exists at a time.
+ * A part that doesn't fit into its buffer waits for its turn and writes what it has, then goes on formatting.
+ */
+
+#ifndef OUTPUTWRITER_H
+#define OUTPUTWRITER_H
+
+#include <atomic>
+#include <fstream>
+#include <thread>
+#include "kmer.h"
+
+#define PART_KMERS (1 << 18) // rows in a part
+#define ROW_MAX 64 // longest row: a 39 digit kmer, two 10 digit counts and ", " "," "\n"
+#define COUNTER_MAX 6 // a 16 bit counter of a row with several phenotypes and its ","
+#define PART_BUFFER (PART_KMERS * ROW_MAX)
+
+// Runs work(thread) on threadCount threads and waits for all of them
+template<typename Work>
+void onThreads(size_t threadCount, Work work){
+    auto *threads = new std::thread[threadCount];
+    for (size_t t = 0; t < threadCount; t++) {
+        threads[t] = std::thread(work, t);
+    }
+    for (size_t t = 0; t < threadCount; t++)
+        threads[t].join();
+    delete[] threads;
+}
+
+// The file and whose turn it is to write
+struct OrderedOutput{
+    std::ofstream &out;
+    std::atomic<size_t> turn{0}; // the part that's allowed to write next
+
+    explicit OrderedOutput(std::ofstream &out): out(out){}
+};
+
+class PartBuffer{
+public:
+    explicit PartBuffer(OrderedOutput &output): output(output){
+        data = new char[PART_BUFFER];
+    }
+    ~PartBuffer(){
+        delete[] data;
+    }
+    PartBuffer(const PartBuffer&) = delete;
+    PartBuffer &operator=(const PartBuffer&) = delete;
+
+    void begin(size_t nextPart){
+        part = nextPart;
+        at = data;
+        writing = false;
+    }
+
+    // Same row as the output always had: "kmer, res,sus"
+    template<typename Kmer>
+    void row(Kmer kmer, uint32_t res, uint32_t sus){
+        if (at + ROW_MAX > data + PART_BUFFER) spill();
+        at = writeKmer(kmer, at);
+        *at++ = ',';
+        *at++ = ' ';
+        at = writeNumber(res, at);
+        *at++ = ',';
+        at = writeNumber(sus, at);
+        *at++ = '\n';
+    }
+
+    // A row with several phenotypes: "kmer, res,sus,res,sus..." with a res and a sus counter for every antibiotic
+    template<typename Kmer>
+    void row(Kmer kmer, const uint16_t *counts, size_t width){
+        if (at + ROW_MAX + width * COUNTER_MAX > data + PART_BUFFER) spill();
+        at = writeKmer(kmer, at);
+        *at++ = ',';
+        for (size_t i = 0; i < width; i++) {
+            *at++ = i ? ',' : ' ';
+            at = writeNumber(counts[i], at);
+        }
+        *at++ = '\n';
+    }
+
+    // Writes the rest of the part and hands the turn to the next one
+    void end(){
+        spill();
+        output.turn.store(part + 1, std::memory_order_release);
+    }
+
+private:
+    OrderedOutput &output;
+    char *data;
+    char *at{};
+    size_t part{};
+    bool writing{}; // this part has its turn already
+
+    void spill(){
+        if (!writing){
+            while (output.turn.load(std::memory_order_acquire) != part) std::this_thread::yield();
+            writing = true;
+        }
+        output.out.write(data, at - data);
+        at = data;
+    }
+};
+
+// format(part, buffer) fills the buffer with the rows of one part
+template<typename Format>
+void writeParts(std::ofstream &out, size_t partCount, size_t threadCount, Format format){
+    OrderedOutput output(out);
+    onThreads(threadCount, [&](size_t thread){
+        PartBuffer buffer(output);
+        for (size_t part = thread; part < partCount; part += threadCount) {
+            buffer.begin(part);
+            format(part, buffer);
+            buffer.end();
+        }
+    });
+}
+
+#endif
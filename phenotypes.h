@@ -0,0 +1,141 @@
+/**
+ * Several phenotypes counted in one pass(--antibiotic-column, --phenotype-columns), usually one per antibiotic. A
+ * genome can be resistant to some antibiotics, susceptible to others and untested for the rest, so every kmer gets a
+ * res and a sus counter per antibiotic.
+ *
+ * The counters live next to the tables, not in their slots. A table hands every new kmer the next row of its
+ * PhenotypeCounters and keeps the row number in the slot's flags, the slot itself only counts in how many genomes the
+ * kmer is. Rows are appended in the order kmers turn up and never move, so growing, compacting and sorting the table
+ * only moves the slot with its row number. A row is every antibiotic's res and sus counter side by side, 16 bits each,
+ * so counting a kmer for a genome touches one or two cache lines no matter how many antibiotics there are.
+ */
+
+#ifndef PHENOTYPES_H
+#define PHENOTYPES_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "filters.h"
+#include "slabMemory.h"
+
+#define NO_PHENOTYPE (-1) // the genome wasn't tested for the antibiotic
+#define MAX_PHENOTYPE_GENOMES 65535 // the counters are 16 bits
+#define SLOT_ROW_SHIFT 1 // the flags of a slot hold its row above SLOT_DIRTY
+
+typedef uint16_t PhenotypeCount;
+
+class PhenotypeSet{
+public:
+    std::vector<std::string> names;
+    std::vector<uint32_t> resAmount; // per antibiotic
+    std::vector<uint32_t> susAmount;
+    std::vector<int8_t> genomes; // genomes[(fileNr - 1) * names.size() + antibiotic]: 1 res, 0 sus or NO_PHENOTYPE
+    std::vector<KmerFilter*> filters; // per antibiotic, a kmer is written if it passes any of them
+
+    explicit PhenotypeSet(std::vector<std::string> antibiotics): names(std::move(antibiotics)){
+        resAmount.assign(names.size(), 0);
+        susAmount.assign(names.size(), 0);
+        offsetStarts.push_back(0);
+    }
+    ~PhenotypeSet(){
+        for (KmerFilter *filter : filters) {
+            delete filter;
+        }
+    }
+    PhenotypeSet(const PhenotypeSet&) = delete;
+    PhenotypeSet &operator=(const PhenotypeSet&) = delete;
+
+    // res and sus of every antibiotic
+    size_t width() const{
+        return 2 * names.size();
+    }
+
+    // Genomes have to be added in file number order, phenotypes can be shorter than names
+    void addGenome(const std::vector<int8_t> &phenotypes){
+        for (size_t i = 0; i < names.size(); i++) {
+            int8_t phenotype = i < phenotypes.size() ? phenotypes[i] : NO_PHENOTYPE;
+            genomes.push_back(phenotype);
+            if (phenotype == NO_PHENOTYPE) continue;
+            offsets.push_back(static_cast<uint16_t>(2 * i + (phenotype ? 0 : 1)));
+            if (phenotype) resAmount[i]++;
+            else susAmount[i]++;
+        }
+        offsetStarts.push_back(static_cast<uint32_t>(offsets.size()));
+    }
+
+    void addFilters(uint32_t minPresence, uint32_t minDiff, double maxP, Test test){
+        for (size_t i = 0; i < names.size(); i++) {
+            filters.push_back(new KmerFilter(minPresence, minDiff, maxP, test, resAmount[i], susAmount[i]));
+        }
+    }
+
+    bool filtered() const{
+        for (const KmerFilter *filter : filters) {
+            if (filter->active()) return true;
+        }
+        return false;
+    }
+
+    bool passes(const PhenotypeCount *row) const{
+        for (size_t i = 0; i < names.size(); i++) {
+            if (filters[i]->passes(row[2 * i], row[2 * i + 1])) return true;
+        }
+        return false;
+    }
+
+    // The counters a genome adds one to: [counterOffsets(fileNr), counterOffsets(fileNr + 1))
+    const uint16_t *counterOffsets(uint32_t fileNr) const{
+        return offsets.data() + offsetStarts[fileNr - 1];
+    }
+
+private:
+    std::vector<uint16_t> offsets;
+    std::vector<uint32_t> offsetStarts;
+};
+
+// The counter rows of one table, see the top of the file
+class PhenotypeCounters{
+public:
+    const PhenotypeSet &set;
+    const size_t width;
+    PhenotypeCount *counts{};
+    size_t rows{};
+
+    explicit PhenotypeCounters(const PhenotypeSet &set): set(set), width(set.width()){
+        capacity = 1024;
+        counts = static_cast<PhenotypeCount*>(allocateZeroed(capacity * width * sizeof(PhenotypeCount)));
+    }
+    ~PhenotypeCounters(){
+        releaseZeroed(counts, capacity * width * sizeof(PhenotypeCount));
+    }
+    PhenotypeCounters(const PhenotypeCounters&) = delete;
+    PhenotypeCounters &operator=(const PhenotypeCounters&) = delete;
+
+    // A row for a kmer that was just seen for the first time, in the genome fileNr
+    uint32_t newRow(uint32_t fileNr){
+        if (rows == capacity){
+            counts = static_cast<PhenotypeCount*>(growZeroed(counts, capacity * width * sizeof(PhenotypeCount), 2 * capacity * width * sizeof(PhenotypeCount)));
+            capacity <<= 1;
+        }
+        auto row = static_cast<uint32_t>(rows++);
+        add(row, fileNr);
+        return row;
+    }
+
+    void add(uint32_t row, uint32_t fileNr){
+        PhenotypeCount *counters = counts + row * width;
+        for (const uint16_t *offset = set.counterOffsets(fileNr); offset != set.counterOffsets(fileNr + 1); offset++) {
+            counters[*offset]++;
+        }
+    }
+
+    const PhenotypeCount *row(uint32_t flags) const{
+        return counts + (size_t) (flags >> SLOT_ROW_SHIFT) * width;
+    }
+
+private:
+    size_t capacity{};
+};
+
+#endif
@@ -0,0 +1,172 @@
+/**
+ * Presence matrix(--presence FILE): which genomes every written kmer is in, for tools that need more than the res/sus
+ * counts. The file is laid out so it can be memory mapped and used as is, nothing in it has to be parsed or decoded.
+ *
+ * Layout(little endian, every section starts at a multiple of 4096):
+ *   header: "KMRP", uint32 version, uint32 k, uint32 flags(1 = canonical), uint32 key bytes(8, or 16 for k > 32),
+ *           uint32 genomes, uint64 rows, uint64 words per column, uint64 keys offset, uint64 columns offset
+ *   keys: one kmer per row, sorted, so the row of a kmer can be found with a binary search
+ *   columns: one bit vector per genome, words per column uint64 each. Row r of genome g is bit r % 64 of word
+ *           r / 64 of column g. The columns are in file number order, FILE.genomes lists the genome of every column
+ *
+ * The rows are the kmers that went into counts.csv/counts.kmc, filtered the same way. The matrix is filled in by
+ * reading every genome a second time after the counts are written: the file is created at its full size and mapped,
+ * the readers look every kmer up in the keys and set its bit right in the mapping, only the pages with bits in them
+ * ever get written to.
+ */
+
+#ifndef PRESENCEFILE_H
+#define PRESENCEFILE_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include "countsFile.h"
+#include "keyDirectory.h"
+#include "phenotypes.h"
+
+#define PRESENCE_MAGIC "KMRP"
+#define PRESENCE_VERSION 1
+#define PRESENCE_ALIGN 4096
+
+struct PresenceHeader{
+    char magic[4];
+    uint32_t version;
+    uint32_t k;
+    uint32_t flags;
+    uint32_t keyBytes;
+    uint32_t genomes;
+    uint64_t rows;
+    uint64_t columnWords;
+    uint64_t keysOffset;
+    uint64_t columnsOffset;
+};
+
+template<typename Kmer>
+class PresenceMatrix{
+public:
+    PresenceHeader header{};
+    Kmer *keys{}; // rows of them, fill them in sorted and call index() before looking anything up
+    uint64_t *columns{};
+    std::string error; // empty if the file could be created
+
+    PresenceMatrix(const std::string &path, size_t k, uint32_t flags, uint32_t genomes, size_t rows){
+        header = {{'K', 'M', 'R', 'P'}, PRESENCE_VERSION, static_cast<uint32_t>(k), flags, sizeof(Kmer), genomes, rows, (rows + 63) / 64, 0, 0};
+        header.keysOffset = alignedTo(sizeof(PresenceHeader), PRESENCE_ALIGN);
+        header.columnsOffset = alignedTo(header.keysOffset + rows * sizeof(Kmer), PRESENCE_ALIGN);
+        size = header.columnsOffset + (uint64_t) genomes * header.columnWords * 8;
+        int fd = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0){
+            error = "couldn't create " + path;
+            return;
+        }
+        // the file is sparse, the columns only take up disk space where bits get set
+        if (ftruncate(fd, static_cast<off_t>(size)) != 0){
+            error = "couldn't make " + path + " " + std::to_string(size >> 20) + " MB big";
+            close(fd);
+            return;
+        }
+        void *mapping = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        close(fd);
+        if (mapping == MAP_FAILED){
+            error = "couldn't map " + path;
+            return;
+        }
+        data = static_cast<char*>(mapping);
+        std::memcpy(data, &header, sizeof(PresenceHeader));
+        keys = reinterpret_cast<Kmer*>(data + header.keysOffset);
+        columns = reinterpret_cast<uint64_t*>(data + header.columnsOffset);
+    }
+    ~PresenceMatrix(){
+        finish();
+    }
+    PresenceMatrix(const PresenceMatrix&) = delete;
+    PresenceMatrix &operator=(const PresenceMatrix&) = delete;
+
+    // The lookups go through a directory of the keys' top bits(keyDirectory.h)
+    void index(){
+        const size_t rows = header.rows;
+        unsigned bits = KeyDirectory<Kmer>::bitsFor(rows, header.k);
+        directory.resize(KeyDirectory<Kmer>::entriesFor(bits));
+        finder = KeyDirectory<Kmer>(header.k, bits, directory.data());
+        for (size_t row = 0; row < rows; row++) {
+            finder.add(directory.data(), keys[row], row);
+        }
+        finder.finish(directory.data(), rows);
+    }
+
+    // header.rows if the kmer isn't in the matrix
+    size_t rowOf(Kmer kmer) const{
+        return finder.rowOf(keys, header.rows, kmer);
+    }
+
+    // Several threads set bits at once, the pieces of a split file even in the same column
+    void set(size_t row, uint32_t column){
+        uint64_t *word = columns + column * header.columnWords + row / 64;
+        uint64_t bit = (uint64_t) 1 << (row % 64);
+        if (!(__atomic_load_n(word, __ATOMIC_RELAXED) & bit)) __atomic_fetch_or(word, bit, __ATOMIC_RELAXED);
+    }
+
+    // Writes the matrix back to the file, false if that failed
+    bool finish(){
+        if (!data) return error.empty();
+        bool written = msync(data, size, MS_SYNC) == 0;
+        munmap(data, size);
+        data = nullptr;
+        return written;
+    }
+
+private:
+    char *data{};
+    uint64_t size{};
+    std::vector<uint64_t> directory;
+    KeyDirectory<Kmer> finder;
+};
+
+// One per reader thread for the second pass
+template<typename K>
+class PresenceRouter{
+public:
+    typedef K Kmer;
+    PresenceMatrix<Kmer> &matrix;
+
+    explicit PresenceRouter(PresenceMatrix<Kmer> &matrix): matrix(matrix){}
+
+    void push(Kmer data, uint32_t fileNr, bool){
+        size_t row = matrix.rowOf(data);
+        if (row != matrix.header.rows) matrix.set(row, fileNr - 1);
+    }
+};
+
+// FILE.genomes: the genome of every column, "column,genome,phenotype". With several phenotypes there's a column per
+// antibiotic instead, empty where the genome wasn't tested
+inline bool writeGenomeIndex(const std::string &path, const GenomeList &genomes, const PhenotypeSet *phenotypes){
+    std::ofstream out(path);
+    out << "column,genome";
+    if (phenotypes){
+        for (const std::string &name : phenotypes->names) {
+            out << "," << name;
+        }
+    }
+    else out << ",phenotype";
+    out << "\n";
+    for (size_t i = 0; i < genomes.ids.size(); i++) {
+        out << i << "," << genomes.ids[i];
+        if (!phenotypes) out << "," << (genomes.resistant[i] ? "resistant" : "susceptible");
+        else for (size_t j = 0; j < phenotypes->names.size(); j++) {
+            int8_t phenotype = phenotypes->genomes[i * phenotypes->names.size() + j];
+            out << "," << (phenotype == NO_PHENOTYPE ? "" : phenotype ? "resistant" : "susceptible");
+        }
+        out << "\n";
+    }
+    out.close();
+    return !out.fail();
+}
+
+#endif
@@ -0,0 +1,258 @@
+/**
+ * Query mode(`./kmerCounter query counts.kidx [--socket PATH]`): answers lookups against a count index(countIndex.h)
+ * in batches, from stdin or from the clients of a local Unix socket. The index is mapped once and every connection
+ * shares it, a lookup is a directory entry and a short binary search, so the time goes into parsing and formatting.
+ *
+ * Every line of a batch is a query:
+ *   a number, a kmer as encoded in counts.csv       -> one line "kmer,res,sus"
+ *   nucleotides, a kmer or a longer sequence        -> one line "kmer,res,sus" for every k long window, in order, with
+ *                                                      the window as it was sent. Windows with anything but A, C, G or
+ *                                                      T in them are 0,0, like kmers that aren't in any genome
+ * A query that can't be answered(shorter than k, not a kmer) gets a line starting with "error:". Empty lines are
+ * skipped. Answers are written once everything that was read so far is answered, so a client can send a batch and
+ * wait for its answers on the same connection.
+ */
+
+#ifndef QUERYSERVER_H
+#define QUERYSERVER_H
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "countIndex.h"
+
+#define QUERY_BUFFER (1 << 20) // bytes read at once, grows for a sequence longer than that
+
+template<typename Kmer>
+class QueryAnswers{
+public:
+    size_t lookups{};
+
+    explicit QueryAnswers(const CountIndex<Kmer> &index): index(index), k(index.header.k){}
+
+    // Appends the answer to one line(without its line break) to out
+    void answer(const char *line, size_t length, std::string &out){
+        while (length && (line[length - 1] == '\r' || line[length - 1] == ' ' || line[length - 1] == '\t')) length--;
+        while (length && (*line == ' ' || *line == '\t')){
+            line++;
+            length--;
+        }
+        if (!length) return;
+        if (std::all_of(line, line + length, [](char c){ return c >= '0' && c <= '9'; })) answerNumber(line, length, out);
+        else answerSequence(line, length, out);
+    }
+
+private:
+    const CountIndex<Kmer> &index;
+    const size_t k;
+
+    void answerNumber(const char *line, size_t length, std::string &out){
+        const Kmer mask = kmerMaskOf<Kmer>(k);
+        Kmer kmer = 0;
+        for (size_t i = 0; i < length; i++) {
+            auto digit = static_cast<unsigned>(line[i] - '0');
+            if (kmer > mask / 10 || mask - kmer * 10 < digit){
+                out.append("error: ").append(line, length).append(" is bigger than a ").append(std::to_string(k)).append("-mer\n");
+                return;
+            }
+            kmer = kmer * 10 + digit;
+        }
+        uint32_t res, sus;
+        index.lookup(canonicalOf(kmer), res, sus);
+        lookups++;
+        char text[64];
+        char *at = writeKmer(kmer, text);
+        appendCounts(text, at, res, sus, out);
+    }
+
+    // Every window of the sequence, the kmer and its reverse complement are rolled along like in the counter
+    void answerSequence(const char *line, size_t length, std::string &out){
+        if (length < k){
+            out.append("error: ").append(line, length).append(" is shorter than k = ").append(std::to_string(k)).append("\n");
+            return;
+        }
+        const Kmer mask = kmerMaskOf<Kmer>(k);
+        const unsigned highShift = static_cast<unsigned>(2 * (k - 1));
+        Kmer kmer = 0, rc = 0;
+        size_t valid = 0; // nucleotides in a row that are A, C, G or T
+        char text[MAX_K + 2 * 11 + 3];
+        for (size_t i = 0; i < length; i++) {
+            Kmer code;
+            switch (line[i]) {
+                case 'a': case 'A': code = 0; break;
+                case 'c': case 'C': code = 1; break;
+                case 'g': case 'G': code = 2; break;
+                case 't': case 'T': code = 3; break;
+                default: code = 4;
+            }
+            if (code == 4) valid = 0;
+            else{
+                kmer = ((kmer << 2) | code) & mask;
+                rc = (rc >> 2) | ((3 - code) << highShift);
+                valid++;
+            }
+            if (i + 1 < k) continue;
+            uint32_t res = 0, sus = 0;
+            if (valid >= k){
+                index.lookup(index.canonical() ? std::min(kmer, rc) : kmer, res, sus);
+                lookups++;
+            }
+            std::memcpy(text, line + i + 1 - k, k);
+            appendCounts(text, text + k, res, sus, out);
+        }
+    }
+
+    Kmer canonicalOf(Kmer kmer) const{
+        return index.canonical() ? std::min(kmer, reverseComplementOf(kmer, k)) : kmer;
+    }
+
+    // at is the end of the kmer already in text
+    static void appendCounts(char *text, char *at, uint32_t res, uint32_t sus, std::string &out){
+        *at++ = ',';
+        at = writeNumber(res, at);
+        *at++ = ',';
+        at = writeNumber(sus, at);
+        *at++ = '\n';
+        out.append(text, at - text);
+    }
+};
+
+inline bool writeAnswers(int fd, const char *data, size_t size){
+    while (size){
+        ssize_t written = write(fd, data, size);
+        if (written < 0 && errno == EINTR) continue;
+        if (written <= 0) return false;
+        data += written;
+        size -= written;
+    }
+    return true;
+}
+
+// Answers the lines read from in on out until in is closed(or out is), returns how many kmers were looked up
+template<typename Kmer>
+size_t serveQueries(const CountIndex<Kmer> &index, int in, int out){
+    QueryAnswers<Kmer> answers(index);
+    std::vector<char> input(QUERY_BUFFER);
+    std::string output;
+    size_t used = 0;
+    while (true){
+        ssize_t got = read(in, input.data() + used, input.size() - used);
+        if (got < 0 && errno == EINTR) continue;
+        if (got <= 0) break;
+        used += got;
+        char *start = input.data(), *end = input.data() + used;
+        while (auto *lineEnd = static_cast<char*>(std::memchr(start, '\n', end - start))){
+            answers.answer(start, lineEnd - start, output);
+            start = lineEnd + 1;
+        }
+        used = end - start;
+        std::memmove(input.data(), start, used);
+        if (used == input.size()) input.resize(2 * input.size());
+        if (!writeAnswers(out, output.data(), output.size())) return answers.lookups;
+        output.clear();
+    }
+    // the last line doesn't need a line break
+    answers.answer(input.data(), used, output);
+    writeAnswers(out, output.data(), output.size());
+    return answers.lookups;
+}
+
+// Batches on stdin, the answers go to stdout so anything else goes to stderr
+template<typename Kmer>
+bool queryStdin(const CountIndex<Kmer> &index){
+    auto start = std::chrono::steady_clock::now();
+    size_t lookups = serveQueries(index, STDIN_FILENO, STDOUT_FILENO);
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cerr << lookups << " lookups in " << seconds << " s";
+    if (lookups) std::cerr << ", " << seconds * 1e6 / lookups << " us per lookup";
+    std::cerr << "\n";
+    return true;
+}
+
+// Every client gets a thread of its own and is answered until it closes the connection. Runs until it's killed, or
+// until the socket breaks, then it waits for the clients that are still connected
+template<typename Kmer>
+bool querySocket(const CountIndex<Kmer> &index, const std::string &path){
+    sockaddr_un address{};
+    if (path.size() >= sizeof(address.sun_path)){
+        std::cout << "the socket path " << path << " is too long\n";
+        return false;
+    }
+    int server = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (server < 0){
+        std::cout << "couldn't create a socket\n";
+        return false;
+    }
+    address.sun_family = AF_UNIX;
+    std::memcpy(address.sun_path, path.c_str(), path.size());
+    unlink(path.c_str());
+    if (bind(server, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 || listen(server, SOMAXCONN) != 0){
+        std::cout << "couldn't listen on " << path << "\n";
+        close(server);
+        return false;
+    }
+    // a client that goes away before its answers are written shouldn't take the server with it
+    std::signal(SIGPIPE, SIG_IGN);
+    std::cout << "listening on " << path << std::endl;
+    // the clients answer from index, which belongs to the caller, so it's only returned once the last one is done
+    std::atomic<size_t> clients{0};
+    while (true){
+        int client = accept(server, nullptr, nullptr);
+        if (client < 0){
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            // out of file descriptors or memory goes away once some clients are gone
+            if (errno == EMFILE || errno == ENFILE || errno == ENOBUFS || errno == ENOMEM){
+                std::this_thread::sleep_for(std::chrono::milliseconds(100));
+                continue;
+            }
+            std::cout << "couldn't accept a connection on " << path << "\n";
+            break;
+        }
+        clients++;
+        std::thread([&index, &clients, client]{
+            serveQueries(index, client, client);
+            close(client);
+            clients--;
+        }).detach();
+    }
+    close(server);
+    unlink(path.c_str());
+    while (clients) std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    return false;
+}
+
+template<typename Kmer>
+bool queryIndex(const std::string &path, const std::string &socketPath){
+    CountIndex<Kmer> index(path);
+    if (!index.error.empty()){
+        std::cout << index.error << "\n";
+        return false;
+    }
+    std::cerr << index.header.k << "-mers" << (index.canonical() ? "(canonical)" : "") << " from "
+              << index.header.resAmount << " resistant and " << index.header.susAmount << " susceptible genomes, "
+              << index.header.rows << " kmers\n";
+    return socketPath.empty() ? queryStdin(index) : querySocket(index, socketPath);
+}
+
+// Answers queries from stdin, or from the socket if there is one
+inline bool runQueries(const std::string &path, const std::string &socketPath){
+    IndexHeader header{};
+    if (!readIndexHeader(path, header)){
+        std::cout << "couldn't open " << path << " as a count index\n";
+        return false;
+    }
+    return wordsFor(header.k) == 1 ? queryIndex<KmerWord<1>::type>(path, socketPath)
+                                   : queryIndex<KmerWord<2>::type>(path, socketPath);
+}
+
+#endif
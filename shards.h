@@ -0,0 +1,167 @@
+/**
+ * Radix sharded counting. Every thread reads files off the FileQueue and also owns one shard of the kmer space, a kmer
+ * belongs to the shard picked by the high bits of its hash. Readers drop kmers they've already seen in the current
+ * file(FileKmerSet) and send the rest to the owning shard in batches through single producer single consumer rings,
+ * one ring for every reader/shard pair. Each distinct kmer ends up in exactly one table, so there's nothing to merge
+ * afterwards and the tables together only hold every kmer once no matter how many threads there are.
+ *
+ * Memory on top of the shard tables: one FileKmerSet per thread (16 bytes a slot, sized for one genome) and
+ * threads^2 rings of RING_SIZE * BATCH_SIZE * 16 bytes(64 KB each). Both double for kmers longer than 32.
+ */
+
+#ifndef SHARDS_H
+#define SHARDS_H
+
+#include <atomic>
+#include <thread>
+#include "kmerTable.h"
+#include "countingBloom.h"
+
+#define BATCH_SIZE 1024 // kmers per batch
+#define RING_SIZE 4 // batches per ring
+
+template<typename Kmer>
+struct KmerEntry{
+    Kmer data;
+    uint32_t fileNr;
+    uint32_t isRes;
+};
+
+template<typename Kmer>
+struct Batch{
+    KmerEntry<Kmer> entries[BATCH_SIZE];
+    size_t size;
+};
+
+// The reader fills batches[tail % RING_SIZE] and bumps tail, the shard owner reads batches[head % RING_SIZE] and
+// bumps head. head and tail live on their own cache lines so the two threads don't fight over them.
+template<typename Kmer>
+struct BatchRing{
+    alignas(64) std::atomic<size_t> head{0};
+    alignas(64) std::atomic<size_t> tail{0};
+    alignas(64) Batch<Kmer> batches[RING_SIZE];
+};
+
+template<typename Kmer>
+class ShardedCounter{
+public:
+    const size_t threadCount;
+    KmerTable<Kmer> **tables; // tables[shard]
+    BatchRing<Kmer> *rings; // rings[reader * threadCount + shard]
+    std::atomic<size_t> readersDone{0};
+
+    ShardedCounter(size_t threadCount, size_t expectedKmers): threadCount(threadCount){
+        tables = new KmerTable<Kmer> *[threadCount];
+        for (size_t i = 0; i < threadCount; i++) {
+            tables[i] = new KmerTable<Kmer>(expectedKmers / threadCount);
+        }
+        rings = new BatchRing<Kmer>[threadCount * threadCount];
+    }
+    ~ShardedCounter(){
+        for (size_t i = 0; i < threadCount; i++) {
+            delete tables[i];
+        }
+        delete[] tables;
+        delete[] rings;
+    }
+    ShardedCounter(const ShardedCounter&) = delete;
+    ShardedCounter &operator=(const ShardedCounter&) = delete;
+
+    // The table index uses the low bits of the same hash, so the shards still fill their tables evenly
+    size_t shardOf(Kmer data) const{
+        return static_cast<size_t>((static_cast<unsigned __int128>(mixHash(data)) * threadCount) >> 64);
+    }
+
+    BatchRing<Kmer> &ring(size_t reader, size_t shard){
+        return rings[reader * threadCount + shard];
+    }
+
+    // Counts every batch that has been sent to the shard so far
+    void drain(size_t shard){
+        KmerTable<Kmer> *table = tables[shard];
+        for (size_t reader = 0; reader < threadCount; reader++) {
+            BatchRing<Kmer> &from = ring(reader, shard);
+            size_t head = from.head.load(std::memory_order_relaxed);
+            size_t tail = from.tail.load(std::memory_order_acquire);
+            for (; head < tail; head++) {
+                const Batch<Kmer> &batch = from.batches[head % RING_SIZE];
+                for (size_t i = 0; i < batch.size; i++) {
+                    table->push(batch.entries[i].data, batch.entries[i].fileNr, batch.entries[i].isRes);
+                }
+                from.head.store(head + 1, std::memory_order_release);
+            }
+        }
+    }
+
+    // Called by a thread once it has read all of its files, keeps counting until every reader is done
+    void finish(size_t shard){
+        readersDone.fetch_add(1, std::memory_order_acq_rel);
+        while (readersDone.load(std::memory_order_acquire) < threadCount){
+            drain(shard);
+            std::this_thread::yield();
+        }
+        drain(shard);
+    }
+};
+
+// One per reader thread, readFile pushes kmers into this instead of a table
+template<typename K>
+class ShardRouter{
+public:
+    typedef K Kmer;
+    ShardedCounter<Kmer> &counter;
+    const size_t reader;
+    FileKmerSet<Kmer> seen;
+    size_t *fill; // how many kmers are in the batch that is being filled for every shard
+    const CountingBloom *prefilter{}; // set in the second pass of --two-pass
+    uint32_t prefilterMin{}; // kmers the first pass saw in fewer genomes than this are left out
+
+    ShardRouter(ShardedCounter<Kmer> &counter, size_t reader, size_t expectedKmers): counter(counter), reader(reader), seen(expectedKmers){
+        fill = new size_t[counter.threadCount]();
+    }
+    ~ShardRouter(){
+        delete[] fill;
+    }
+    ShardRouter(const ShardRouter&) = delete;
+    ShardRouter &operator=(const ShardRouter&) = delete;
+
+    void push(Kmer data, uint32_t fileNr, bool isRes){
+        if (!seen.insert(data, fileNr)) return;
+        if (prefilter && prefilter->count(mixHash(data)) < prefilterMin) return;
+        size_t shard = counter.shardOf(data);
+        if (shard == reader){
+            counter.tables[shard]->push(data, fileNr, isRes);
+            return;
+        }
+        BatchRing<Kmer> &to = counter.ring(reader, shard);
+        size_t tail = to.tail.load(std::memory_order_relaxed);
+        if (fill[shard] == 0){
+            // starting a new batch, wait until the shard owner is done with the one that used to be in this spot
+            while (tail - to.head.load(std::memory_order_acquire) >= RING_SIZE){
+                counter.drain(reader);
+                std::this_thread::yield();
+            }
+        }
+        to.batches[tail % RING_SIZE].entries[fill[shard]++] = {data, fileNr, isRes};
+        if (fill[shard] == BATCH_SIZE) publish(shard);
+    }
+
+    void publish(size_t shard){
+        BatchRing<Kmer> &to = counter.ring(reader, shard);
+        size_t tail = to.tail.load(std::memory_order_relaxed);
+        to.batches[tail % RING_SIZE].size = fill[shard];
+        to.tail.store(tail + 1, std::memory_order_release);
+        fill[shard] = 0;
+        // keep this thread's own shard moving so other readers don't have to wait for it
+        counter.drain(reader);
+    }
+
+    // Sends the batches that aren't full yet
+    void flush(){
+        for (size_t shard = 0; shard < counter.threadCount; shard++) {
+            if (fill[shard]) publish(shard);
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,65 @@
+/**
+ * Memory for the big flat arrays: the kmer tables, the per file kmer sets, the dense counters and the counting bloom
+ * filter. Arrays of at least SLAB_MIN bytes are mapped straight from the kernel instead of going through malloc. The
+ * pages are zero and only backed once they get written to(like calloc), they're asked to be transparent huge pages so
+ * a table of tens of GB is a few thousand pages to fault in, look up and tear down instead of millions, a slab grows by
+ * moving its mapping(mremap) without copying or zeroing anything, and giving it back is a single munmap.
+ *
+ * Smaller arrays stay with malloc, the size alone decides which one an array is so nothing else needs remembering.
+ */
+
+#ifndef SLABMEMORY_H
+#define SLABMEMORY_H
+
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <sys/mman.h>
+
+#define SLAB_MIN (2 << 20) // bytes, one huge page
+
+inline bool isSlab(size_t bytes){
+    return bytes >= SLAB_MIN;
+}
+
+inline void *mapSlab(size_t bytes){
+    void *memory = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (memory == MAP_FAILED) throw std::bad_alloc();
+    madvise(memory, bytes, MADV_HUGEPAGE);
+    return memory;
+}
+
+inline void *allocateZeroed(size_t bytes){
+    if (isSlab(bytes)) return mapSlab(bytes);
+    void *memory = std::calloc(bytes, 1);
+    if (!memory) throw std::bad_alloc();
+    return memory;
+}
+
+// The first oldBytes are kept, everything after them is zero
+inline void *growZeroed(void *memory, size_t oldBytes, size_t newBytes){
+    if (isSlab(oldBytes)){
+        void *moved = mremap(memory, oldBytes, newBytes, MREMAP_MAYMOVE);
+        if (moved == MAP_FAILED) throw std::bad_alloc();
+        madvise(moved, newBytes, MADV_HUGEPAGE);
+        return moved;
+    }
+    if (isSlab(newBytes)){
+        void *slab = mapSlab(newBytes);
+        std::memcpy(slab, memory, oldBytes);
+        std::free(memory);
+        return slab;
+    }
+    void *grown = std::realloc(memory, newBytes);
+    if (!grown) throw std::bad_alloc();
+    std::memset(static_cast<char*>(grown) + oldBytes, 0, newBytes - oldBytes);
+    return grown;
+}
+
+inline void releaseZeroed(void *memory, size_t bytes){
+    if (!memory) return;
+    if (isSlab(bytes)) munmap(memory, bytes);
+    else std::free(memory);
+}
+
+#endif
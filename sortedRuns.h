@@ -0,0 +1,159 @@
+/**
+ * The order counts are written in and the sorted runs(shard tables or counted bins of --max-mem) that the output is
+ * merged from. Every run is sorted on the thread that counted it, the writers only merge them, so the parts of the
+ * output can be cut out of the runs and formatted on every thread at once.
+ */
+
+#ifndef SORTEDRUNS_H
+#define SORTEDRUNS_H
+
+#include <algorithm>
+#include <queue>
+#include <type_traits>
+#include <vector>
+#include "kmerTable.h"
+#include "outputWriter.h"
+
+#define MAX_SAMPLES (1 << 20) // most kmers splitRuns copies to pick the cuts from
+
+// The most differentiating kmers(biggest difference between res and sus) come first. Kmers with the same difference
+// are ordered by value so the output is the same no matter how many threads were used
+template<typename Kmer>
+bool writeOrder(const Slot<Kmer> &a, const Slot<Kmer> &b){
+    uint32_t diffA = a.resOccurences > a.susOccurences ? a.resOccurences - a.susOccurences : a.susOccurences - a.resOccurences;
+    uint32_t diffB = b.resOccurences > b.susOccurences ? b.resOccurences - b.susOccurences : b.susOccurences - b.resOccurences;
+    if (diffA != diffB) return diffA > diffB;
+    return a.data < b.data;
+}
+
+// counts.kmc is sorted by kmer so the keys can be delta encoded
+template<typename Kmer>
+bool valueOrder(const Slot<Kmer> &a, const Slot<Kmer> &b){
+    return a.data < b.data;
+}
+
+// Sorted arrays of slots the output is merged from, the shard tables or the counted bins of --max-mem
+template<typename Kmer>
+struct SortedRuns{
+    std::vector<const Slot<Kmer>*> slots;
+    std::vector<size_t> sizes;
+    std::vector<const PhenotypeCounters*> phenotypes; // the counter rows of every run, only with several phenotypes
+
+    size_t count() const{
+        return slots.size();
+    }
+};
+
+// Hands the slots in [begins[run], ends[run]) of every run to write, in the order the runs were sorted in. write
+// gets the run of the slot as well if it takes it
+template<typename Kmer, typename Order, typename Write>
+void mergeRuns(const SortedRuns<Kmer> &runs, const size_t *begins, const size_t *ends, Order order, Write write){
+    const size_t runCount = runs.count();
+    auto *positions = new size_t[runCount];
+    std::copy(begins, begins + runCount, positions);
+    auto later = [&](size_t a, size_t b){
+        return order(runs.slots[b][positions[b]], runs.slots[a][positions[a]]);
+    };
+    std::priority_queue<size_t, std::vector<size_t>, decltype(later)> fronts(later);
+    for (size_t i = 0; i < runCount; i++) {
+        if (positions[i] < ends[i]) fronts.push(i);
+    }
+    while (!fronts.empty()){
+        size_t run = fronts.top();
+        fronts.pop();
+        if constexpr (std::is_invocable_v<Write, const Slot<Kmer>&, size_t>) write(runs.slots[run][positions[run]], run);
+        else write(runs.slots[run][positions[run]]);
+        if (++positions[run] < ends[run]) fronts.push(run);
+    }
+    delete[] positions;
+}
+
+// Cuts the sorted runs into parts of about PART_KMERS rows that follow each other in the output. Part p is
+// [bounds[p * runCount + run], bounds[(p + 1) * runCount + run]) of every run. The cuts are taken from a sample of
+// every run so the parts are only roughly the same size, that's all the writers need. order is the one the runs are
+// sorted in.
+template<typename Kmer, typename Order>
+std::vector<size_t> splitRuns(const SortedRuns<Kmer> &runs, size_t &partCount, Order order){
+    const size_t runCount = runs.count();
+    size_t kmerCount = 0;
+    for (size_t run = 0; run < runCount; run++) {
+        kmerCount += runs.sizes[run];
+    }
+    partCount = (kmerCount + PART_KMERS - 1) / PART_KMERS;
+    std::vector<size_t> bounds((partCount + 1) * runCount);
+    if (partCount == 0) return bounds;
+    const size_t stride = std::max<size_t>({1, PART_KMERS / (16 * runCount), kmerCount / MAX_SAMPLES});
+    std::vector<Slot<Kmer>> samples;
+    for (size_t run = 0; run < runCount; run++) {
+        for (size_t i = 0; i < runs.sizes[run]; i += stride) {
+            samples.push_back(runs.slots[run][i]);
+        }
+    }
+    std::sort(samples.begin(), samples.end(), order);
+    for (size_t part = 1; part < partCount; part++) {
+        const Slot<Kmer> &cut = samples[part * samples.size() / partCount];
+        for (size_t run = 0; run < runCount; run++) {
+            const Slot<Kmer> *slots = runs.slots[run];
+            bounds[part * runCount + run] = std::lower_bound(slots, slots + runs.sizes[run], cut, order) - slots;
+        }
+    }
+    for (size_t run = 0; run < runCount; run++) {
+        bounds[partCount * runCount + run] = runs.sizes[run];
+    }
+    return bounds;
+}
+
+// Same layout as splitRuns for runs that weren't sorted(--unsorted): the runs are written one after the other and
+// every part holds PART_KMERS rows of a single run
+template<typename Kmer>
+std::vector<size_t> cutRuns(const SortedRuns<Kmer> &runs, size_t &partCount){
+    const size_t runCount = runs.count();
+    std::vector<size_t> bounds(runCount, 0);
+    for (size_t run = 0; run < runCount; run++) {
+        for (size_t i = 0; i < runs.sizes[run]; ) {
+            i = std::min(i + PART_KMERS, runs.sizes[run]);
+            for (size_t other = 0; other < runCount; other++) {
+                bounds.push_back(other < run ? runs.sizes[other] : other == run ? i : 0);
+            }
+        }
+    }
+    partCount = bounds.size() / runCount - 1;
+    return bounds;
+}
+
+// The kmers of all runs sorted by value into keys(--presence). The runs may be in write order, so every run's kmers
+// are copied and sorted on their own on the threads and then merged
+template<typename Kmer>
+void sortedKeys(const SortedRuns<Kmer> &runs, size_t threadCount, Kmer *keys){
+    const size_t runCount = runs.count();
+    std::vector<size_t> starts(runCount + 1, 0);
+    for (size_t run = 0; run < runCount; run++) {
+        starts[run + 1] = starts[run] + runs.sizes[run];
+    }
+    std::vector<Kmer> copied(starts[runCount]);
+    onThreads(threadCount, [&](size_t thread){
+        for (size_t run = thread; run < runCount; run += threadCount) {
+            Kmer *to = copied.data() + starts[run];
+            for (size_t i = 0; i < runs.sizes[run]; i++) {
+                to[i] = runs.slots[run][i].data;
+            }
+            std::sort(to, to + runs.sizes[run]);
+        }
+    });
+    std::vector<size_t> positions(starts.begin(), starts.end() - 1);
+    auto later = [&](size_t a, size_t b){
+        return copied[positions[b]] < copied[positions[a]];
+    };
+    std::priority_queue<size_t, std::vector<size_t>, decltype(later)> fronts(later);
+    for (size_t run = 0; run < runCount; run++) {
+        if (positions[run] < starts[run + 1]) fronts.push(run);
+    }
+    while (!fronts.empty()){
+        size_t run = fronts.top();
+        fronts.pop();
+        *keys++ = copied[positions[run]];
+        if (++positions[run] < starts[run + 1]) fronts.push(run);
+    }
+}
+
+#endif
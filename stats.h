@@ -0,0 +1,136 @@
+/**
+ * --stats FILE: what a run spent its time and memory on, written as JSON once it's done so runs can be compared.
+ *
+ * Phases follow each other, a phase starts where the one before it ended. When several threads end the same phase it
+ * lasts until the last of them, so the phases add up to the wall time of the run. Per reader thread it records the
+ * files and bytes read, per table the load, the resizes and how far kmers sit from their home slot.
+ */
+
+#ifndef STATS_H
+#define STATS_H
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <sys/resource.h>
+
+typedef std::chrono::steady_clock::time_point TimePoint;
+
+inline double msBetween(TimePoint start, TimePoint end){
+    return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+struct ReaderStats{
+    size_t files;
+    size_t pieces; // pieces of split files among the files
+    size_t streamed;
+    size_t bytes;
+    double ms;
+};
+
+// The tables of one kind added up, shards are one each, the bins of --max-mem are all in one
+struct TableStats{
+    std::string name;
+    size_t tables{};
+    size_t slots{};
+    size_t kmers{};
+    size_t resizes{};
+    double resizeMs{};
+    size_t probeTotal{}; // summed distance of every kmer from the slot its hash points to
+    size_t longestProbe{};
+};
+
+class RunStats{
+public:
+    RunStats(): begin(std::chrono::steady_clock::now()){}
+
+    // Ends the phase called name now
+    void endPhase(const std::string &name){
+        std::lock_guard<std::mutex> lock(mutex);
+        TimePoint now = std::chrono::steady_clock::now();
+        if (!phases.empty() && phases.back().name == name) phases.back().end = std::max(phases.back().end, now);
+        else phases.push_back({name, phases.empty() ? begin : phases.back().end, now});
+    }
+
+    void reader(const ReaderStats &reader){
+        std::lock_guard<std::mutex> lock(mutex);
+        readers.push_back(reader);
+    }
+
+    void table(const std::string &name, size_t slots, size_t kmers, size_t resizes, double resizeMs, size_t probeTotal, size_t longestProbe){
+        std::lock_guard<std::mutex> lock(mutex);
+        auto found = std::find_if(tables.begin(), tables.end(), [&](const TableStats &table){ return table.name == name; });
+        if (found == tables.end()){
+            tables.push_back(TableStats{name});
+            found = tables.end() - 1;
+        }
+        found->tables++;
+        found->slots += slots;
+        found->kmers += kmers;
+        found->resizes += resizes;
+        found->resizeMs += resizeMs;
+        found->probeTotal += probeTotal;
+        found->longestProbe = std::max(found->longestProbe, longestProbe);
+    }
+
+    // Anything else worth keeping, like how many genomes or kmers there were
+    void value(const std::string &name, double number){
+        std::lock_guard<std::mutex> lock(mutex);
+        values.emplace_back(name, number);
+    }
+
+    bool write(const std::string &path){
+        std::lock_guard<std::mutex> lock(mutex);
+        std::ofstream out(path);
+        out.precision(15); // counts stay whole numbers
+        out << "{\n";
+        for (const auto &value : values) {
+            out << "  \"" << value.first << "\": " << value.second << ",\n";
+        }
+        out << "  \"phases\": [";
+        for (size_t i = 0; i < phases.size(); i++) {
+            out << (i ? ",\n" : "\n") << "    {\"name\": \"" << phases[i].name << "\", \"ms\": " << msBetween(phases[i].start, phases[i].end) << "}";
+        }
+        out << "\n  ],\n  \"total_ms\": " << msBetween(begin, std::chrono::steady_clock::now()) << ",\n  \"readers\": [";
+        for (size_t i = 0; i < readers.size(); i++) {
+            const ReaderStats &reader = readers[i];
+            double seconds = reader.ms / 1000;
+            out << (i ? ",\n" : "\n") << "    {\"files\": " << reader.files << ", \"pieces\": " << reader.pieces
+                << ", \"streamed\": " << reader.streamed << ", \"bytes\": " << reader.bytes << ", \"ms\": " << reader.ms
+                << ", \"bytes_per_s\": " << (seconds > 0 ? reader.bytes / seconds : 0) << "}";
+        }
+        out << "\n  ],\n  \"tables\": [";
+        for (size_t i = 0; i < tables.size(); i++) {
+            const TableStats &table = tables[i];
+            out << (i ? ",\n" : "\n") << "    {\"name\": \"" << table.name << "\", \"tables\": " << table.tables
+                << ", \"slots\": " << table.slots << ", \"kmers\": " << table.kmers
+                << ", \"load\": " << (table.slots ? (double) table.kmers / table.slots : 0)
+                << ", \"resizes\": " << table.resizes << ", \"resize_ms\": " << table.resizeMs
+                << ", \"mean_probe\": " << (table.kmers ? (double) table.probeTotal / table.kmers : 0)
+                << ", \"longest_probe\": " << table.longestProbe << "}";
+        }
+        // ru_maxrss is in KB on Linux
+        struct rusage usage{};
+        getrusage(RUSAGE_SELF, &usage);
+        out << "\n  ],\n  \"peak_rss_mb\": " << usage.ru_maxrss / 1024.0 << "\n}\n";
+        return !out.fail();
+    }
+
+private:
+    struct Phase{
+        std::string name;
+        TimePoint start;
+        TimePoint end;
+    };
+    std::mutex mutex;
+    const TimePoint begin;
+    std::vector<Phase> phases;
+    std::vector<ReaderStats> readers;
+    std::vector<TableStats> tables;
+    std::vector<std::pair<std::string, double>> values;
+};
+
+#endif
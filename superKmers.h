@@ -0,0 +1,379 @@
+/**
+ * Minimizer bucketing(--super-kmers). Consecutive kmers of a genome land all over a big table, so nearly every push
+ * is a cache miss. Here the readers don't count anything: a run of consecutive kmers that share the same minimizer
+ * bucket(a super-k-mer) is stored once as its first kmer and one 2 bit code for every kmer after it, in the bucket its
+ * minimizer picks. Once every genome is read the buckets are counted one at a time per thread with a table that only
+ * has to hold the bucket's kmers, a few hundred KB to a few MB, so it stays in the cache while the bucket streams
+ * through it.
+ *
+ * The minimizer of a kmer is its MINIMIZER_LENGTH-mer with the lowest hash, found with a sliding window minimum as the
+ * kmers roll along, and the bucket comes from the high bits of a hash of that hash. Neighbouring kmers mostly have the same
+ * minimizer, so a super-k-mer holds about (k - MINIMIZER_LENGTH) / 2 kmers at a few bits each instead of a slot each.
+ * In canonical mode the readers only get the lower of every kmer and its reverse complement, the router works out
+ * which strand continues the run and stores the run on its own strand, the m-mers are hashed as the lower of them and
+ * their reverse complement so a kmer and its reverse complement have the same minimizer.
+ *
+ * Every reader has a stream per bucket and reads its files one after the other, so the kmers of one genome are
+ * together in every stream and the table can tell a new genome by the slot's fileNr, the FileKmerSet isn't needed.
+ * A piece of a split file only has kmers no other piece has, so that holds for split files too. A stream is a list of
+ * records: FILE_MARKER, uint32 fileNr and a res byte when the genome changes, otherwise the number of kmers after the
+ * first one, the first kmer in (2k + 7) / 8 bytes and those kmers' codes four to a byte.
+ *
+ * Every kmer of every genome is kept in the buckets until it's counted, about 1 to 3 bytes per kmer occurrence(less
+ * the bigger k is). With --max-mem, or when that wouldn't fit into the free memory, the buckets spill to bin files
+ * (diskBins.h): a reader's stream that reaches its share of the budget is appended to its bucket's bin file as a chunk
+ * tagged with the reader, and cleared. A bucket is decoded reader by reader, the reader's chunks in the order they were
+ * written and then what's left in memory, so every reader's records still come in the order it read its files.
+ */
+
+#ifndef SUPERKMERS_H
+#define SUPERKMERS_H
+
+#include <atomic>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <unistd.h>
+#include "diskBins.h"
+#include "fastaScanner.h"
+#include "kmerTable.h"
+#include "outputWriter.h"
+
+#define MINIMIZER_LENGTH 11
+#define MAX_EXTENSION 254 // kmers after the first one in a record, the count takes a byte
+#define FILE_MARKER 255
+#define BUCKET_KMERS (1 << 15) // distinct kmers a bucket is meant to hold, its table is then about 1 to 2 MB
+#define MIN_BUCKETS_PER_THREAD 8 // enough buckets that the threads finish counting at about the same time
+#define MAX_BUCKETS 4096
+#define MIN_SPILL_BYTES 4096 // a stream that spills to disk is written out once it's this big at least
+#define MAX_SPILL_BYTES (1 << 20)
+#define MAX_RECORD_BYTES (1 + MAX_K / 4 + (MAX_EXTENSION + 3) / 4 + 6) // a super-k-mer and a file marker
+
+// MemAvailable from /proc/meminfo, or the free pages where there's no such thing
+inline size_t availableMemory(){
+    std::ifstream meminfo("/proc/meminfo");
+    std::string key;
+    size_t kilobytes;
+    while (meminfo >> key >> kilobytes){
+        if (key == "MemAvailable:") return kilobytes << 10;
+        meminfo.ignore(64, '\n');
+    }
+    return (size_t) sysconf(_SC_AVPHYS_PAGES) * sysconf(_SC_PAGESIZE);
+}
+
+// The streams of every reader, streams[reader * bucketCount + bucket]
+template<typename Kmer>
+class SuperKmerBuckets{
+public:
+    const size_t k;
+    const bool canonical;
+    const size_t readerCount;
+    const size_t bucketCount;
+    std::vector<uint8_t> *streams;
+    std::atomic<size_t> superKmers{0}; // for the report
+    std::atomic<size_t> kmers{0};
+    BinFiles *spill{}; // the bin files the streams spill to, only when they're bounded
+    size_t spillBytes = SIZE_MAX; // a stream is appended to its bin file once it has this many bytes
+
+    SuperKmerBuckets(size_t k, bool canonical, size_t readerCount, size_t bucketCount): k(k), canonical(canonical), readerCount(readerCount), bucketCount(bucketCount){
+        streams = new std::vector<uint8_t>[readerCount * bucketCount];
+    }
+    ~SuperKmerBuckets(){
+        delete[] streams;
+    }
+    SuperKmerBuckets(const SuperKmerBuckets&) = delete;
+    SuperKmerBuckets &operator=(const SuperKmerBuckets&) = delete;
+
+    // About how many bytes the streams of all genomes take, totalBytes being the size of all genome files
+    static size_t estimatedBytes(size_t totalBytes, size_t k){
+        const double kmersPerSuperKmer = std::max(1.0, (static_cast<double>(k) - MINIMIZER_LENGTH + 2) / 2);
+        return static_cast<size_t>(static_cast<double>(totalBytes) * (0.25 + static_cast<double>((2 * k + 7) / 8 + 1) / kmersPerSuperKmer));
+    }
+
+    // Bounds the streams to memory bytes in total, the rest goes to files
+    void spillTo(BinFiles &files, size_t memory){
+        spill = &files;
+        spillBytes = std::clamp<size_t>(memory / (readerCount * bucketCount), MIN_SPILL_BYTES, MAX_SPILL_BYTES);
+    }
+
+    // Enough buckets for about BUCKET_KMERS distinct kmers each. That's unknown before counting, it's guessed as the
+    // biggest genome times the square root of the number of genomes since related genomes share most of their kmers
+    static size_t bucketCountFor(size_t largestGenome, size_t genomes, size_t threadCount){
+        const double distinct = static_cast<double>(largestGenome) * std::sqrt(static_cast<double>(genomes));
+        size_t count = 1;
+        while (count < MAX_BUCKETS && (count < threadCount * MIN_BUCKETS_PER_THREAD || distinct / count > BUCKET_KMERS)) count <<= 1;
+        return count;
+    }
+
+    std::vector<uint8_t> &stream(size_t reader, size_t bucket){
+        return streams[reader * bucketCount + bucket];
+    }
+
+    // In memory and on disk
+    size_t bytes() const{
+        size_t total = spill ? spill->bytesWritten.load() : 0;
+        for (size_t i = 0; i < readerCount * bucketCount; i++) {
+            total += streams[i].size();
+        }
+        return total;
+    }
+
+    // Called by a reader after it added to a stream
+    void added(size_t reader, size_t bucket){
+        std::vector<uint8_t> &from = stream(reader, bucket);
+        if (from.size() < spillBytes) return;
+        spill->appendChunk(bucket, static_cast<uint32_t>(reader), from.data(), from.size());
+        from.clear();
+    }
+
+    // Calls push(kmer, fileNr, isRes) for every kmer of the bucket, reader by reader, and frees its streams. false if
+    // its bin file is broken
+    template<typename Push>
+    bool decode(size_t bucket, Push push){
+        std::vector<std::vector<std::pair<const uint8_t*, size_t>>> chunks(readerCount);
+        MappedFile *bin = nullptr;
+        bool complete = true;
+        if (spill && access(spill->binPath(bucket).c_str(), F_OK) == 0){
+            bin = new MappedFile(spill->binPath(bucket));
+            complete = bin->opened && readChunks(*bin, [&](uint32_t reader, const uint8_t *data, size_t size){
+                if (reader >= readerCount) return false;
+                chunks[reader].emplace_back(data, size);
+                return true;
+            });
+        }
+        for (size_t reader = 0; reader < readerCount && complete; reader++) {
+            uint32_t fileNr = 0;
+            bool isRes = false;
+            for (const auto &chunk : chunks[reader]) {
+                decodeRecords(chunk.first, chunk.first + chunk.second, fileNr, isRes, push);
+            }
+            std::vector<uint8_t> &from = stream(reader, bucket);
+            decodeRecords(from.data(), from.data() + from.size(), fileNr, isRes, push);
+            std::vector<uint8_t>().swap(from);
+        }
+        if (bin){
+            delete bin;
+            std::remove(spill->binPath(bucket).c_str());
+        }
+        return complete;
+    }
+
+private:
+    // The file a record belongs to carries over from one chunk of a reader to the next
+    template<typename Push>
+    void decodeRecords(const uint8_t *at, const uint8_t *end, uint32_t &fileNr, bool &isRes, Push &push){
+        const Kmer mask = kmerMaskOf<Kmer>(k);
+        const size_t kmerBytes = (2 * k + 7) / 8;
+        const unsigned rcShift = 2 * (k - 1);
+        while (at < end){
+            uint8_t extension = *at++;
+            if (extension == FILE_MARKER){
+                std::memcpy(&fileNr, at, sizeof(fileNr));
+                isRes = at[sizeof(fileNr)];
+                at += sizeof(fileNr) + 1;
+                continue;
+            }
+            Kmer data = 0;
+            std::memcpy(&data, at, kmerBytes);
+            at += kmerBytes;
+            if (canonical){
+                Kmer rc = reverseComplementOf(data, k);
+                push(kmerOf<true>(data, rc), fileNr, isRes);
+                for (size_t i = 0; i < extension; i++) {
+                    shiftIn<true>(data, rc, (at[i >> 2] >> (2 * (i & 3))) & 3, mask, rcShift);
+                    push(kmerOf<true>(data, rc), fileNr, isRes);
+                }
+            }
+            else{
+                push(data, fileNr, isRes);
+                for (size_t i = 0; i < extension; i++) {
+                    data = ((data << 2) | ((at[i >> 2] >> (2 * (i & 3))) & 3)) & mask;
+                    push(data, fileNr, isRes);
+                }
+            }
+            at += (extension + 3) / 4;
+        }
+    }
+};
+
+// One per reader thread, readFile pushes kmers into this instead of a table
+template<typename K>
+class SuperKmerRouter{
+public:
+    typedef K Kmer;
+    SuperKmerBuckets<Kmer> &buckets;
+    const size_t reader;
+
+    SuperKmerRouter(SuperKmerBuckets<Kmer> &buckets, size_t reader): buckets(buckets), reader(reader),
+            minimizerLength(std::min<size_t>(buckets.k, MINIMIZER_LENGTH)), window(buckets.k - minimizerLength + 1),
+            mask(kmerMaskOf<Kmer>(buckets.k)), rcShift(2 * (buckets.k - 1)), kmerBytes((2 * buckets.k + 7) / 8){
+        lastFiles.assign(buckets.bucketCount, 0);
+        hashes.resize(window + 1);
+        positions.resize(window + 1);
+    }
+    SuperKmerRouter(const SuperKmerRouter&) = delete;
+    SuperKmerRouter &operator=(const SuperKmerRouter&) = delete;
+
+    void push(Kmer data, uint32_t fileNr, bool isRes){
+        // a kmer that's the last one shifted by a nucleotide continues the run, anything else starts over. Two runs
+        // that happen to overlap like that spell out the same kmers either way
+        bool follows = kmers && fileNr == this->fileNr;
+        Kmer forward = data, reverse = 0;
+        if (follows){
+            if ((data & ~(Kmer) 3) == ((last << 2) & mask)){
+                if (buckets.canonical) reverse = (lastReverse >> 2) | ((Kmer) (3 - (data & 3)) << rcShift);
+            }
+            else if (buckets.canonical && (data & (mask >> 2)) == (lastReverse >> 2)){
+                // the reverse complement continues the run
+                reverse = data;
+                forward = ((last << 2) | ((Kmer) 3 - (data >> rcShift))) & mask;
+            }
+            else follows = false;
+        }
+        if (!follows && buckets.canonical) reverse = reverseComplementOf(data, buckets.k);
+        last = forward;
+        lastReverse = reverse;
+        if (follows){
+            position++;
+            addMinimizer(static_cast<size_t>(forward) & minimizerMask(), static_cast<size_t>(reverse >> (2 * (window - 1))), position + window - 1);
+            while (positions[first] < position){
+                first = (first + 1) % hashes.size();
+                size--;
+            }
+            size_t bucket = bucketOf(hashes[first]);
+            if (bucket == this->bucket && kmers <= MAX_EXTENSION){
+                codes[kmers - 1] = static_cast<uint8_t>(forward & 3);
+                kmers++;
+                return;
+            }
+            flush();
+            start(forward, bucket);
+            return;
+        }
+        flush();
+        this->fileNr = fileNr;
+        this->isRes = isRes;
+        // the window of a fresh run is every m-mer of the kmer
+        position = 0;
+        first = 0;
+        size = 0;
+        for (size_t i = 0; i < window; i++) {
+            addMinimizer(static_cast<size_t>(forward >> (2 * (window - 1 - i))) & minimizerMask(), static_cast<size_t>(reverse >> (2 * i)) & minimizerMask(), i);
+        }
+        start(forward, bucketOf(hashes[first]));
+    }
+
+    // Stores the super-k-mer that's being built
+    void flush(){
+        if (!kmers) return;
+        std::vector<uint8_t> &to = buckets.stream(reader, bucket);
+        // a stream that spills never grows past its limit and a record
+        if (buckets.spill && !to.capacity()) to.reserve(buckets.spillBytes + MAX_RECORD_BYTES);
+        if (lastFiles[bucket] != fileNr){
+            lastFiles[bucket] = fileNr;
+            to.push_back(FILE_MARKER);
+            to.insert(to.end(), reinterpret_cast<const uint8_t*>(&fileNr), reinterpret_cast<const uint8_t*>(&fileNr) + sizeof(fileNr));
+            to.push_back(isRes);
+        }
+        size_t extension = kmers - 1;
+        to.push_back(static_cast<uint8_t>(extension));
+        to.insert(to.end(), reinterpret_cast<const uint8_t*>(&firstKmer), reinterpret_cast<const uint8_t*>(&firstKmer) + kmerBytes);
+        for (size_t i = 0; i < extension; i += 4) {
+            uint8_t packed = 0;
+            for (size_t j = i; j < std::min(i + 4, extension); j++) {
+                packed |= codes[j] << (2 * (j - i));
+            }
+            to.push_back(packed);
+        }
+        if (buckets.spill) buckets.added(reader, bucket);
+        superKmers++;
+        kmerCount += kmers;
+        kmers = 0;
+    }
+
+    ~SuperKmerRouter(){
+        flush();
+        buckets.superKmers += superKmers;
+        buckets.kmers += kmerCount;
+    }
+
+private:
+    const size_t minimizerLength;
+    const size_t window; // m-mers in a kmer
+    const Kmer mask;
+    const unsigned rcShift;
+    const size_t kmerBytes;
+    std::vector<uint32_t> lastFiles; // the genome every stream of this reader is at
+    // the run of kmers that's being built
+    Kmer firstKmer{};
+    Kmer last{}; // on the strand the run is stored on
+    Kmer lastReverse{}; // its reverse complement, only in canonical mode
+    uint8_t codes[MAX_EXTENSION];
+    size_t kmers{}; // in the super-k-mer, 0 before the first kmer
+    size_t bucket{};
+    uint32_t fileNr{};
+    bool isRes{};
+    size_t superKmers{};
+    size_t kmerCount{};
+    // sliding window minimum: the m-mers that can still become the minimum, lowest hash first. The ring has room for
+    // one more than the window, the m-mer that just left it is only dropped after the new one is in
+    size_t position{}; // of the current kmer in the run
+    std::vector<size_t> hashes;
+    std::vector<size_t> positions;
+    size_t first{};
+    size_t size{};
+
+    size_t minimizerMask() const{
+        return ((size_t) 1 << (2 * minimizerLength)) - 1;
+    }
+
+    // The lowest hash of a window is far from evenly spread, it's hashed once more so the buckets get about as many
+    // minimizers each
+    size_t bucketOf(size_t hash) const{
+        return static_cast<size_t>((static_cast<unsigned __int128>(mixHash(static_cast<size_t>(hash ^ 0x9e3779b97f4a7c15ULL))) * buckets.bucketCount) >> 64);
+    }
+
+    void start(Kmer data, size_t bucket){
+        firstKmer = data;
+        this->bucket = bucket;
+        kmers = 1;
+    }
+
+    // Drops the m-mers from the back that can't be the minimum anymore now that there's a lower one after them
+    void addMinimizer(size_t mmer, size_t reverse, size_t at){
+        size_t hash = mixHash(buckets.canonical ? std::min(mmer, reverse) : mmer);
+        while (size && hashes[(first + size - 1) % hashes.size()] > hash) size--;
+        size_t back = (first + size) % hashes.size();
+        hashes[back] = hash;
+        positions[back] = at;
+        size++;
+    }
+};
+
+// Counts the buckets on threadCount threads with one table per thread that's cleared for every bucket, the buckets
+// are about the same size so it's rarely grown after the first. counted(bucket, table) gets every bucket's table
+// before the next bucket goes into it. false if a bin file the buckets spilled to is broken
+template<typename Kmer, typename Counted>
+bool countBuckets(SuperKmerBuckets<Kmer> &buckets, size_t threadCount, Counted counted){
+    std::atomic<size_t> nextBucket{0};
+    std::atomic<bool> failed{false};
+    onThreads(threadCount, [&](size_t){
+        KmerTable<Kmer> table(BUCKET_KMERS);
+        for (size_t bucket = nextBucket++; bucket < buckets.bucketCount && !failed; bucket = nextBucket++) {
+            table.clear(0);
+            bool complete = buckets.decode(bucket, [&](Kmer data, uint32_t fileNr, bool isRes){
+                table.push(data, fileNr, isRes);
+            });
+            if (!complete){
+                failed = true;
+                std::cout << "couldn't read " << buckets.spill->binPath(bucket) << "\n";
+            }
+            else counted(bucket, table);
+        }
+    });
+    return !failed;
+}
+
+#endif
@@ -0,0 +1,125 @@
+/**
+ * Deterministic synthetic genome collections for the benchmarks(bench.cpp). The same settings and seed always give
+ * the same files byte for byte, so runs on different builds or machines read exactly the same input.
+ *
+ * Every genome is cut into segments of SEGMENT_LENGTH nucleotides. A segment is either copied from a core sequence
+ * that all genomes draw from(with probability shared, at the same position in every genome) or made up on the spot,
+ * so shared is about the fraction of a genome's kmers that other genomes have as well. Made up nucleotides are G or C
+ * with probability gc. The genome is split into contigs of about the same length, each with its own header, and
+ * written LINE_WIDTH nucleotides a line. meta.csv has the genome id in the second column and "Resistant"/"Susceptible"
+ * in the fifth, the columns Metadata(metadata.h) reads when --id-column and --phenotype-column aren't given.
+ */
+
+#ifndef SYNTHETICGENOMES_H
+#define SYNTHETICGENOMES_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#define SEGMENT_LENGTH 1000 // nucleotides that are shared or made up together
+#define LINE_WIDTH 80
+
+struct GeneratorSettings{
+    size_t genomes = 16;
+    size_t length = 1000000; // nucleotides per genome
+    double gc = 0.5;
+    double shared = 0.5; // chance that a segment comes from the core sequence
+    size_t contigs = 1; // records per genome
+    double resistant = 0.5; // fraction of the genomes that are resistant
+    uint64_t seed = 1;
+};
+
+// splitmix64, small and fast and every seed gives a good stream
+class SplitMix{
+public:
+    explicit SplitMix(uint64_t seed): state(seed){}
+
+    uint64_t next(){
+        uint64_t z = (state += 0x9e3779b97f4a7c15ULL);
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+        return z ^ (z >> 31);
+    }
+
+    // uniform in [0, 1)
+    double real(){
+        return (next() >> 11) * (1.0 / 9007199254740992.0);
+    }
+
+private:
+    uint64_t state;
+};
+
+inline char randomNucleotide(SplitMix &random, double gc){
+    uint64_t bits = random.next();
+    bool strong = (bits >> 11) * (1.0 / 9007199254740992.0) < gc;
+    return strong ? ((bits & 1) ? 'G' : 'C') : ((bits & 1) ? 'T' : 'A');
+}
+
+inline std::string genomeId(size_t genome){
+    char id[32];
+    std::snprintf(id, sizeof(id), "SYN%06zu", genome + 1);
+    return id;
+}
+
+// Spreads the resistant genomes evenly over the collection instead of putting them all first
+inline bool isResistant(const GeneratorSettings &settings, size_t genome){
+    return (size_t) ((genome + 1) * settings.resistant) > (size_t) (genome * settings.resistant);
+}
+
+// The nucleotides of one genome, every genome has a random stream of its own so they can be made in any order
+inline std::string makeGenome(const GeneratorSettings &settings, const std::string &core, size_t genome){
+    SplitMix random(settings.seed ^ (0xd1b54a32d192ed03ULL * (genome + 1)));
+    std::string sequence(settings.length, 'A');
+    for (size_t start = 0; start < settings.length; start += SEGMENT_LENGTH) {
+        size_t end = std::min(start + SEGMENT_LENGTH, settings.length);
+        if (random.real() < settings.shared) sequence.replace(start, end - start, core, start, end - start);
+        else for (size_t i = start; i < end; i++) sequence[i] = randomNucleotide(random, settings.gc);
+    }
+    return sequence;
+}
+
+// Writes genomes SYN000001.fna... and meta.csv into folder, returns how many bytes of fasta that was(0 if it failed)
+inline size_t generateGenomes(const GeneratorSettings &settings, const std::string &folder){
+    std::error_code error;
+    std::filesystem::create_directories(folder, error);
+    if (error) return 0;
+    SplitMix coreRandom(settings.seed);
+    std::string core(settings.length, 'A');
+    for (char &nucleotide : core) {
+        nucleotide = randomNucleotide(coreRandom, settings.gc);
+    }
+    std::ofstream meta(folder + "/meta.csv");
+    meta << "\"Taxon ID\",\"Genome ID\",\"Genome Name\",\"Antibiotic\",\"Resistant Phenotype\",\"Source\"\n";
+    size_t bytes = 0;
+    const size_t contigs = std::max<size_t>(1, std::min(settings.contigs, settings.length));
+    for (size_t genome = 0; genome < settings.genomes; genome++) {
+        std::string id = genomeId(genome);
+        std::string sequence = makeGenome(settings, core, genome);
+        std::string text;
+        text.reserve(settings.length + settings.length / LINE_WIDTH + contigs * 64);
+        for (size_t contig = 0; contig < contigs; contig++) {
+            size_t begin = settings.length * contig / contigs, end = settings.length * (contig + 1) / contigs;
+            text += ">" + id + "_" + std::to_string(contig + 1) + " synthetic genome " + std::to_string(genome + 1) + " contig " + std::to_string(contig + 1) + "\n";
+            for (size_t line = begin; line < end; line += LINE_WIDTH) {
+                text.append(sequence, line, std::min<size_t>(LINE_WIDTH, end - line));
+                text += '\n';
+            }
+        }
+        std::ofstream out(folder + "/" + id + ".fna", std::ios::binary);
+        out.write(text.data(), (std::streamsize) text.size());
+        if (!out) return 0;
+        bytes += text.size();
+        meta << "1280,\"" << id << "\",\"Synthetic genome " << genome + 1 << "\",\"synthetic\",\""
+             << (isResistant(settings, genome) ? "Resistant" : "Susceptible") << "\",\"bench\"\n";
+    }
+    meta.close();
+    return meta ? bytes : 0;
+}
+
+#endif